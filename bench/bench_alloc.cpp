@@ -0,0 +1,205 @@
+// bench_alloc.cpp - allocations per probe in steady state
+//
+// Counts every malloc-family call the process makes while run_suite runs
+// against a loopback server, the way a --daemon round repeats the suite:
+// after warm-up rounds, one round at K repetitions per test and one at 4K.
+// Whatever a run costs regardless of its size (result arena, logger thread,
+// curl multi handle) cancels out in the difference; what remains is the cost
+// of a probe from start to verdict. That must be zero for our code. libcurl's
+// own allocations are counted separately through curl_global_init_mem and
+// only reported: curl allocates per connection, and every probe opens one.
+//
+// The server runs in a forked child, so its threads do not count. Exits 1 if
+// the engine allocates per probe.
+//
+// usage: bench_alloc [--times K] [--warmup N] [--timeout ms] [--reactors N]
+
+#include "loopback_server.h"
+
+#include "../src/context.h"
+#include "../src/engine.h"
+#include "../src/suite.h"
+
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string>
+
+extern "C" {
+void* __libc_malloc(size_t n);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* p, size_t n);
+void* __libc_memalign(size_t align, size_t n);
+void __libc_free(void* p);
+}
+
+static std::atomic<bool> counting{false};
+static std::atomic<size_t> allocations{0};
+static std::atomic<size_t> curl_allocations{0};
+
+static void count() {
+    if (counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Everything, operator new included, ends up here.
+extern "C" {
+void* malloc(size_t n) {
+    count();
+    return __libc_malloc(n);
+}
+void* calloc(size_t n, size_t size) {
+    count();
+    return __libc_calloc(n, size);
+}
+void* realloc(void* p, size_t n) {
+    count();
+    return __libc_realloc(p, n);
+}
+void* aligned_alloc(size_t align, size_t n) {
+    count();
+    return __libc_memalign(align, n);
+}
+void* memalign(size_t align, size_t n) {
+    count();
+    return __libc_memalign(align, n);
+}
+int posix_memalign(void** out, size_t align, size_t n) {
+    count();
+    void* p = __libc_memalign(align, n);
+    if (!p) return ENOMEM;
+    *out = p;
+    return 0;
+}
+void free(void* p) { __libc_free(p); }
+}
+
+// libcurl's allocations bypass the counters above.
+static void* counted_malloc(size_t n) {
+    if (counting.load(std::memory_order_relaxed)) curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_malloc(n);
+}
+static void* counted_calloc(size_t n, size_t size) {
+    if (counting.load(std::memory_order_relaxed)) curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_calloc(n, size);
+}
+static void* counted_realloc(void* p, size_t n) {
+    if (counting.load(std::memory_order_relaxed)) curl_allocations.fetch_add(1, std::memory_order_relaxed);
+    return __libc_realloc(p, n);
+}
+static char* counted_strdup(const char* s) {
+    const size_t n = std::strlen(s) + 1;
+    char* p = static_cast<char*>(counted_malloc(n));
+    if (p) std::memcpy(p, s, n);
+    return p;
+}
+static void counted_free(void* p) { __libc_free(p); }
+
+// Lines are formatted and queued as usual, then dropped.
+static void discard_sink(dpi::LogKind, const char*, void*) {}
+
+struct Round {
+    size_t probes = 0;
+    size_t allocations = 0;
+    size_t curl_allocations = 0;
+};
+
+static Round measure(dpi::Context& ctx, int times) {
+    for (auto& t : ctx.tests) t.times = times;
+    allocations = 0;
+    curl_allocations = 0;
+    counting = true;
+    dpi::run_suite(ctx);
+    counting = false;
+    return Round{ctx.store.count, allocations.load(), curl_allocations.load()};
+}
+
+int main(int argc, char** argv) {
+    int times = 16, warmup = 3, reactors = 1;
+    long timeout_ms = 300;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--times" && i + 1 < argc) times = std::stoi(argv[++i]);
+        else if (arg == "--warmup" && i + 1 < argc) warmup = std::stoi(argv[++i]);
+        else if (arg == "--timeout" && i + 1 < argc) timeout_ms = std::stol(argv[++i]);
+        else if (arg == "--reactors" && i + 1 < argc) reactors = std::stoi(argv[++i]);
+        else {
+            std::cerr << "usage: bench_alloc [--times K] [--warmup N] [--timeout ms] [--reactors N]\n";
+            return 2;
+        }
+    }
+    times = std::max(1, times);
+
+    // Forked before this process starts any thread.
+    int fds[2];
+    if (pipe(fds) != 0) return 1;
+    const pid_t child = fork();
+    if (child < 0) return 1;
+    if (child == 0) {
+        ::close(fds[0]);
+        LoopbackServer server;
+        uint16_t port = server.start() ? server.port : 0;
+        [[maybe_unused]] ssize_t w = ::write(fds[1], &port, sizeof(port));
+        ::close(fds[1]);
+        if (port) pause();
+        _exit(0);
+    }
+    ::close(fds[1]);
+    uint16_t port = 0;
+    if (::read(fds[0], &port, sizeof(port)) != sizeof(port) || port == 0) {
+        std::cerr << "cannot listen on 127.0.0.1\n";
+        return 1;
+    }
+    ::close(fds[0]);
+
+    curl_global_init_mem(CURL_GLOBAL_DEFAULT, counted_malloc, counted_free, counted_realloc, counted_strdup, counted_calloc);
+    int status = 0;
+    {
+        dpi::Context ctx;
+        ctx.cfg.timeout_ms = timeout_ms;
+        ctx.cfg.seed = 1;
+        ctx.cfg.reactors = reactors;
+        ctx.log.sink = discard_sink;
+        ctx.log.flush = nullptr;
+        const std::string base = std::format("http://127.0.0.1:{}", port);
+        const std::string suite = std::format(
+            "[{{\"id\": \"BIG-01\", \"provider\": \"bench\", \"url\": \"{0}/big\"}},"
+            " {{\"id\": \"SML-01\", \"provider\": \"bench\", \"url\": \"{0}/small\"}},"
+            " {{\"id\": \"FRZ-01\", \"provider\": \"bench\", \"url\": \"{0}/freeze\"}},"
+            " {{\"id\": \"UP-01\", \"provider\": \"bench\", \"url\": \"{0}/upload\", \"type\": \"upload\"}}]",
+            base);
+        if (!dpi::loadTestSuiteFromJson(ctx, suite)) {
+            std::cerr << "suite parse failed\n";
+            status = 1;
+        } else {
+            for (int i = 0; i < warmup; ++i) measure(ctx, 4 * times);
+            const Round small = measure(ctx, times);
+            const Round large = measure(ctx, 4 * times);
+            const double extra = static_cast<double>(large.probes - small.probes);
+            const double per_probe = (static_cast<double>(large.allocations) - small.allocations) / extra;
+            const double curl_per_probe =
+                (static_cast<double>(large.curl_allocations) - small.curl_allocations) / extra;
+
+            for (const Round& r : {small, large}) {
+                std::cout << std::format("{:>6} probes: {:>8} allocations, {:>8} in libcurl\n", r.probes,
+                                         r.allocations, r.curl_allocations);
+            }
+            std::cout << std::format("per probe: {:.3f} allocations, {:.1f} in libcurl\n", per_probe, curl_per_probe);
+            // A vector outgrowing its capacity once is noise, one per probe is not.
+            if (per_probe > 0.01) {
+                std::cout << "FAIL: the probe path allocates\n";
+                status = 1;
+            }
+        }
+        dpi::free_handles(ctx);
+    }
+    curl_global_cleanup();
+    kill(child, SIGTERM);
+    waitpid(child, nullptr, 0);
+    return status;
+}
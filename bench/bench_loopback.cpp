@@ -0,0 +1,195 @@
+// bench_loopback.cpp - end-to-end probe runs against an in-process server
+//
+// Runs the whole engine (suite parse, pre-resolution, probes, verdicts) over
+// loopback, so it needs no network. Reports wall and CPU time per round; the
+// CPU figure is what matters on small probe boxes. It includes the server
+// threads, which do the same work every round.
+//
+// Every entry of the suite has one expected verdict and detail, and every
+// slot of every round is checked against it; exits 1 on any mismatch. The
+// server speaks no QUIC, so the h3 entry must fail: "Protocol not supported"
+// if libcurl has no HTTP/3, else with a curl error.
+//
+// There is no QUIC stand-in yet, so h3 verdicts are only exercised with
+// --h3-url: a QUIC endpoint serving at least the threshold (like /big), whose
+// probes must end NotDetected / early abort. Skipped, with a note, when
+// libcurl has no HTTP/3.
+//
+// usage: bench_loopback [--rounds N] [--times K] [--timeout ms] [--h3-url URL] [--verbose]
+//        bench_loopback --serve suite.json [--seconds S] [--times K]
+//
+// --serve only runs the server for S seconds (default 60) and writes a suite
+// pointing at it, so dpi_check itself can be driven offline:
+// dpi_check --suite file://$PWD/suite.json
+
+#include "loopback_server.h"
+
+#include "../src/context.h"
+#include "../src/engine.h"
+#include "../src/suite.h"
+
+#include <sys/resource.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+static double cpu_ms() {
+    rusage ru{};
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000.0 + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1000.0;
+}
+
+struct Expected {
+    const char* id;
+    dpi::Verdict verdict;
+    dpi::Detail detail;
+};
+
+// localhost entries go through getaddrinfo_a, 127.0.0.1 ones skip it.
+static std::string make_suite(const LoopbackServer& server, int times, const std::string& h3_url,
+                              std::vector<Expected>& expected) {
+    using dpi::Verdict;
+    using dpi::Detail;
+    const std::string local = std::format("http://localhost:{}", server.port);
+    std::string suite = "[\n";
+    auto entry = [&](const char* id, const std::string& url, int n, const char* type, Verdict v, Detail d,
+                     const char* protocol = nullptr) {
+        expected.push_back({id, v, d});
+        if (suite.size() > 2) suite += ",\n";
+        suite += std::format("  {{\"id\": \"{}\", \"provider\": \"bench\", \"url\": \"{}\", \"times\": {}{}{}}}",
+                             id, url, n, type ? std::format(", \"type\": \"{}\"", type) : "",
+                             protocol ? std::format(", \"protocol\": \"{}\"", protocol) : "");
+    };
+    const bool has_h3 = curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP3;
+    entry("BIG-01", server.url("/big"), times, nullptr, Verdict::NotDetected, Detail::EarlyAbort);
+    entry("BIG-02", local + "/big", times, nullptr, Verdict::NotDetected, Detail::EarlyAbort);
+    entry("SML-01", server.url("/small"), times, nullptr, Verdict::PossiblyDetected, Detail::StreamTooSmall);
+    entry("FRZ-01", server.url("/freeze"), times, nullptr, Verdict::Detected, Detail::TimeoutPartial);
+    entry("UP-01", local + "/upload", times, "upload", Verdict::NotDetected, Detail::EarlyAbort);
+    // The server's 4 KiB receive buffer acknowledges a few KiB before the
+    // upload stalls, so this is a partial, not a zero-byte, timeout.
+    entry("UPF-01", server.url("/upfreeze"), std::max(1, times / 4), "upload", Verdict::Detected, Detail::UploadStalled);
+    entry("H3-01", server.url("/big"), 1, nullptr, Verdict::Failed, has_h3 ? Detail::CurlError : Detail::Unsupported,
+          "h3");
+    if (has_h3 && !h3_url.empty()) {
+        entry("H3-02", h3_url, times, nullptr, Verdict::NotDetected, Detail::EarlyAbort, "h3");
+    }
+    suite += "\n]\n";
+    return suite;
+}
+
+int main(int argc, char** argv) {
+    int rounds = 20, times = 8, serve_seconds = 60, reactors = 1;
+    long timeout_ms = 300;
+    bool verbose = false;
+    std::string serve_path, h3_url;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--rounds" && i + 1 < argc) rounds = std::stoi(argv[++i]);
+        else if (arg == "--times" && i + 1 < argc) times = std::stoi(argv[++i]);
+        else if (arg == "--timeout" && i + 1 < argc) timeout_ms = std::stol(argv[++i]);
+        else if (arg == "--reactors" && i + 1 < argc) reactors = std::stoi(argv[++i]);
+        else if (arg == "--serve" && i + 1 < argc) serve_path = argv[++i];
+        else if (arg == "--seconds" && i + 1 < argc) serve_seconds = std::stoi(argv[++i]);
+        else if (arg == "--h3-url" && i + 1 < argc) h3_url = argv[++i];
+        else if (arg == "--verbose") verbose = true;
+        else {
+            std::cerr << "usage: bench_loopback [--rounds N] [--times K] [--timeout ms] [--reactors N] [--h3-url URL]"
+                         " [--verbose]\n"
+                         "       bench_loopback --serve suite.json [--seconds S] [--times K]\n";
+            return 2;
+        }
+    }
+
+    LoopbackServer server;
+    if (!server.start()) {
+        std::cerr << "cannot listen on 127.0.0.1\n";
+        return 1;
+    }
+    std::vector<Expected> expected;
+    const std::string suite = make_suite(server, times, h3_url, expected);
+    if (!h3_url.empty() && !(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP3)) {
+        std::cout << "libcurl has no HTTP/3, --h3-url skipped\n";
+    }
+
+    if (!serve_path.empty()) {
+        // Written to a temporary name first so readers never see half a suite.
+        {
+            std::ofstream f(serve_path + ".tmp", std::ios::trunc);
+            f << suite;
+            if (!f) {
+                std::cerr << "cannot write " << serve_path << "\n";
+                return 1;
+            }
+        }
+        std::rename((serve_path + ".tmp").c_str(), serve_path.c_str());
+        std::cout << std::format("serving on 127.0.0.1:{} for {} s, suite in {}\n", server.port, serve_seconds, serve_path)
+                  << std::flush;
+        std::this_thread::sleep_for(seconds(serve_seconds));
+        return 0;
+    }
+
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    dpi::Context ctx;
+    ctx.cfg.timeout_ms = timeout_ms;
+    ctx.cfg.seed = 1;
+    ctx.cfg.reactors = reactors;
+    if (!verbose) ctx.log.sink = nullptr;
+    if (!dpi::loadTestSuiteFromJson(ctx, suite)) {
+        std::cerr << "suite parse failed\n";
+        return 1;
+    }
+
+    size_t wrong = 0;
+    std::string first_wrong;
+    std::vector<double> wall, cpu;
+    size_t probes = 0, verdicts[static_cast<size_t>(dpi::Verdict::Count)] = {};
+    for (int r = 0; r < rounds; ++r) {
+        const auto t0 = steady_clock::now();
+        const double c0 = cpu_ms();
+        dpi::run_suite(ctx);
+        cpu.push_back(cpu_ms() - c0);
+        wall.push_back(duration_cast<duration<double, std::milli>>(steady_clock::now() - t0).count());
+        probes += ctx.store.count;
+        for (size_t i = 0; i < ctx.store.count; ++i) {
+            verdicts[static_cast<size_t>(ctx.store.verdict[i])]++;
+            const std::string& id = ctx.strings.str(ctx.store.id[i]);
+            auto e = std::find_if(expected.begin(), expected.end(), [&](const Expected& x) { return id == x.id; });
+            if (e != expected.end() && ctx.store.verdict[i] == e->verdict && ctx.store.detail[i] == e->detail) continue;
+            if (wrong++ == 0) {
+                first_wrong = std::format("{}@{}: {} / {}", id, ctx.store.rep[i],
+                                          dpi::VERDICT_KEY[static_cast<size_t>(ctx.store.verdict[i])],
+                                          dpi::detail_text(ctx.store, i));
+            }
+        }
+    }
+    server.stop();
+    dpi::free_handles(ctx);
+    curl_global_cleanup();
+
+    auto stats = [](std::vector<double> v) {
+        std::sort(v.begin(), v.end());
+        return std::format("min {:.1f} median {:.1f} max {:.1f}", v.front(), v[v.size() / 2], v.back());
+    };
+    double cpu_total = 0;
+    for (double c : cpu) cpu_total += c;
+    std::cout << std::format("rounds {} probes {}\n", rounds, probes);
+    std::cout << "wall ms/round: " << stats(wall) << "\n";
+    std::cout << "cpu ms/round:  " << stats(cpu) << "\n";
+    std::cout << std::format("cpu us/probe:  {:.1f}\n", cpu_total * 1000.0 / std::max<size_t>(1, probes));
+    std::cout << std::format("verdicts: not detected {} | possibly {} | detected {} | failed {}\n",
+                             verdicts[0], verdicts[1], verdicts[2] + verdicts[3], verdicts[4]);
+    if (wrong > 0) {
+        std::cout << std::format("FAIL: {} of {} probes not as expected, first {}\n", wrong, probes, first_wrong);
+        return 1;
+    }
+    return 0;
+}
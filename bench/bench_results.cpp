@@ -0,0 +1,144 @@
+// bench_results.cpp - result export, history and diff on a large synthetic run
+//
+// Fills a ResultStore with N results (no network), then times the per-round
+// output path: NDJSON export, history append, loading the prior round and
+// diffing against it, plus rendering every result as a status row (on the
+// calling thread, leaving out the logger thread's hand-off). Exits 1 if the
+// two files do not read back every result.
+//
+// usage: bench_results [--results N] [--dir path]
+
+#include "../src/context.h"
+#include "../src/history.h"
+#include "../src/log.h"
+#include "../src/report.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <format>
+#include <iostream>
+#include <string>
+
+using namespace std::chrono;
+
+template <class F>
+static double time_ms(F&& f) {
+    const auto t0 = steady_clock::now();
+    f();
+    return duration_cast<duration<double, std::milli>>(steady_clock::now() - t0).count();
+}
+
+// Deterministic pseudo-run: 1/8 of the tests freeze, the rest pass.
+static void fill(dpi::Context& ctx, size_t n, uint32_t variant) {
+    const int times = 4;
+    ctx.tests.clear();
+    for (size_t i = 0; i < n / times; ++i) {
+        dpi::Test t;
+        t.id = ctx.strings.intern(std::format("T-{:06}", i));
+        t.provider = ctx.strings.intern(std::format("P{}", i % 37));
+        t.url = std::format("https://h{}.example/{}", i % 101, i);
+        t.times = times;
+        ctx.tests.push_back(std::move(t));
+    }
+    dpi::ResultStore& store = ctx.store;
+    store.allocate(ctx.tests.size() * times);
+    for (size_t slot = 0; slot < store.count; ++slot) {
+        const dpi::Test& t = ctx.tests[slot / times];
+        const bool frozen = ((slot / times) + variant) % 8 == 0;
+        store.test[slot] = static_cast<uint32_t>(slot / times);
+        store.id[slot] = t.id;
+        store.provider[slot] = t.provider;
+        store.rep[slot] = static_cast<uint32_t>(slot % times);
+        store.target[slot] = dpi::NO_TARGET;
+        store.ip[slot] = dpi::parse_ip(std::format("10.{}.{}.{}", slot >> 16 & 255, slot >> 8 & 255, slot & 255).c_str());
+        store.http_code[slot] = 200;
+        store.received[slot] = frozen ? 16000 + variant * 4096 : 65536;
+        store.uploaded[slot] = 0;
+        store.elapsed_ms[slot] = frozen ? 5000.0 : 120.0 + slot % 50;
+        store.stall_ms[slot] = frozen ? 4800.0 : 0.0;
+        store.curl_code[slot] = frozen ? CURLE_OPERATION_TIMEDOUT : CURLE_ABORTED_BY_CALLBACK;
+        store.local_port[slot] = 0;
+        store.http_version[slot] = CURL_HTTP_VERSION_1_1;
+        store.kind[slot] = dpi::ProbeKind::Download;
+        store.verdict[slot] = frozen ? dpi::Verdict::Detected : dpi::Verdict::NotDetected;
+        store.detail[slot] = frozen ? dpi::Detail::TimeoutPartial : dpi::Detail::EarlyAbort;
+    }
+}
+
+static size_t rendered_bytes = 0;
+
+static void count_sink(dpi::LogKind, const char* text, void*) { rendered_bytes += std::strlen(text); }
+
+int main(int argc, char** argv) {
+    size_t n = 100000;
+    std::string dir = "/tmp";
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--results" && i + 1 < argc) n = std::stoull(argv[++i]);
+        else if (arg == "--dir" && i + 1 < argc) dir = argv[++i];
+        else {
+            std::cerr << "usage: bench_results [--results N] [--dir path]\n";
+            return 2;
+        }
+    }
+    const std::string base = std::format("{}/bench_results.{}", dir, getpid());
+    const std::string ndjson = base + ".ndjson", history_path = base + ".dpih";
+
+    dpi::Context ctx;
+    ctx.log.sink = nullptr;
+    fill(ctx, n, 0);
+
+    bool written = false;
+    double t_ndjson = time_ms([&] { written = dpi::append_ndjson(ctx, ndjson, 1000, 0); });
+    double t_history = 0;
+    {
+        dpi::HistoryWriter history;
+        if (!history.open(history_path)) {
+            std::cerr << "cannot open " << history_path << "\n";
+            return 1;
+        }
+        t_history = time_ms([&] { written = history.append(ctx.strings, ctx.store, 1000, 0) && written; });
+    }
+
+    dpi::PriorIndex prior_ndjson, prior_history;
+    double t_load_ndjson = time_ms([&] { dpi::load_prior(ndjson, prior_ndjson); });
+    double t_load_history = time_ms([&] { dpi::load_prior(history_path, prior_history); });
+
+    fill(ctx, n, 1);
+    double t_diff = time_ms([&] { dpi::log_diff(ctx, prior_ndjson); });
+    double t_index = time_ms([&] { dpi::index_results(ctx, prior_ndjson); });
+
+    ctx.log.sink = count_sink;
+    ctx.log.flush = nullptr;
+    double t_rows = time_ms([&] {
+        std::string id;
+        for (size_t i = 0; i < ctx.store.count; ++i) {
+            id.clear();
+            dpi::append_result_id(id, ctx.strings, ctx.tests[ctx.store.test[i]], ctx.store, i);
+            dpi::log_result(ctx.log, ctx.store, i, id);
+        }
+    });
+
+    std::remove(ndjson.c_str());
+    std::remove(history_path.c_str());
+    std::remove((history_path + ".strings").c_str());
+
+    std::cout << std::format("results {}\n", ctx.store.count);
+    std::cout << std::format("append_ndjson      {:8.1f} ms\n", t_ndjson);
+    std::cout << std::format("history append     {:8.1f} ms\n", t_history);
+    std::cout << std::format("load_prior ndjson  {:8.1f} ms ({} results)\n", t_load_ndjson, prior_ndjson.size());
+    std::cout << std::format("load_prior history {:8.1f} ms ({} results)\n", t_load_history, prior_history.size());
+    std::cout << std::format("log_diff           {:8.1f} ms\n", t_diff);
+    std::cout << std::format("index_results      {:8.1f} ms\n", t_index);
+    std::cout << std::format("log_result rows    {:8.1f} ms ({:.0f} ns/row, {} bytes)\n", t_rows,
+                             t_rows * 1e6 / std::max<size_t>(1, ctx.store.count), rendered_bytes);
+    // Every result has its own key, so both files must read back whole.
+    if (!written || prior_ndjson.size() != ctx.store.count || prior_history.size() != ctx.store.count) {
+        std::cout << "FAIL: results did not round-trip through NDJSON and history\n";
+        return 1;
+    }
+    return 0;
+}
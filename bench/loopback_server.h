@@ -0,0 +1,166 @@
+// loopback_server.h - in-process HTTP/1.1 server for offline benchmarks
+//
+// Serves the shapes the checker has to tell apart, on 127.0.0.1:
+//   GET  /big        256 KiB body
+//   GET  /small      1 KiB body
+//   GET  /freeze     announces 1 MiB, sends 16000 bytes, then goes silent
+//   POST /upload     reads and discards the body, then answers 200
+//   POST /upfreeze   never reads the body (small receive buffer)
+// It has no UDP side, so h3 probes against it cannot connect.
+#pragma once
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <format>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct LoopbackServer {
+    int listen_fd = -1;
+    uint16_t port = 0;
+    std::atomic<bool> stopping{false};
+    std::thread acceptor;
+    std::mutex conns_mtx;
+    std::vector<std::thread> conns;
+
+    bool start() {
+        listen_fd = ::socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd < 0) return false;
+        int one = 1;
+        setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+        // Inherited by accepted sockets, so /upfreeze stalls after a few KiB
+        // instead of after whatever the kernel would buffer on loopback.
+        int rcvbuf = 4096;
+        setsockopt(listen_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        if (::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+            ::listen(listen_fd, 512) != 0 ||
+            getsockname(listen_fd, reinterpret_cast<sockaddr*>(&addr), &len) != 0) {
+            ::close(listen_fd);
+            listen_fd = -1;
+            return false;
+        }
+        port = ntohs(addr.sin_port);
+        acceptor = std::thread([this] { accept_loop(); });
+        return true;
+    }
+
+    void stop() {
+        stopping = true;
+        if (listen_fd >= 0) ::shutdown(listen_fd, SHUT_RDWR);
+        if (acceptor.joinable()) acceptor.join();
+        if (listen_fd >= 0) ::close(listen_fd);
+        listen_fd = -1;
+        std::lock_guard<std::mutex> lk(conns_mtx);
+        for (auto& t : conns) t.join();
+        conns.clear();
+    }
+
+    ~LoopbackServer() { stop(); }
+
+    std::string url(const char* path) const { return std::format("http://127.0.0.1:{}{}", port, path); }
+
+private:
+    void accept_loop() {
+        while (!stopping) {
+            int fd = ::accept4(listen_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (stopping) return;
+                continue;
+            }
+            std::lock_guard<std::mutex> lk(conns_mtx);
+            conns.emplace_back([this, fd] { serve(fd); ::close(fd); });
+        }
+    }
+
+    // Waits for the peer to go away (or the server to stop).
+    void hold(int fd) {
+        char buf[4096];
+        pollfd p{fd, POLLIN, 0};
+        while (!stopping) {
+            int n = ::poll(&p, 1, 50);
+            if (n < 0) return;
+            if (n == 0) continue;
+            if (::recv(fd, buf, sizeof(buf), 0) <= 0) return;
+        }
+    }
+
+    bool send_all(int fd, const char* p, size_t n) {
+        while (n > 0) {
+            ssize_t w = ::send(fd, p, n, MSG_NOSIGNAL);
+            if (w <= 0) return false;
+            p += w;
+            n -= static_cast<size_t>(w);
+        }
+        return true;
+    }
+
+    bool send_body(int fd, size_t n) {
+        static const std::string chunk(16 * 1024, 'x');
+        while (n > 0) {
+            size_t k = std::min(n, chunk.size());
+            if (!send_all(fd, chunk.data(), k)) return false;
+            n -= k;
+        }
+        return true;
+    }
+
+    void serve(int fd) {
+        std::string req;
+        char buf[4096];
+        size_t head_end;
+        while ((head_end = req.find("\r\n\r\n")) == std::string::npos) {
+            ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+            if (n <= 0) return;
+            req.append(buf, static_cast<size_t>(n));
+        }
+        const size_t sp = req.find(' ');
+        std::string path = req.substr(sp + 1, req.find(' ', sp + 1) - sp - 1);
+        path = path.substr(0, path.find('?'));
+
+        auto header = [&](size_t body_len) {
+            std::string h = std::format("HTTP/1.1 200 OK\r\nContent-Type: application/octet-stream\r\n"
+                                        "Content-Length: {}\r\nConnection: close\r\n\r\n", body_len);
+            return send_all(fd, h.data(), h.size());
+        };
+
+        if (path == "/big") {
+            if (header(256 * 1024)) send_body(fd, 256 * 1024);
+        } else if (path == "/small") {
+            if (header(1024)) send_body(fd, 1024);
+        } else if (path == "/freeze") {
+            if (header(1024 * 1024) && send_body(fd, 16000)) hold(fd);
+        } else if (path == "/upload") {
+            size_t cl = 0;
+            size_t p = req.find("Content-Length: ");
+            if (p != std::string::npos && p < head_end) cl = std::stoull(req.substr(p + 16));
+            size_t got = req.size() - head_end - 4;
+            while (got < cl) {
+                ssize_t n = ::recv(fd, buf, sizeof(buf), 0);
+                if (n <= 0) return;
+                got += static_cast<size_t>(n);
+            }
+            header(0);
+        } else if (path == "/upfreeze") {
+            while (!stopping) {
+                pollfd p{fd, POLLRDHUP, 0};
+                if (::poll(&p, 1, 50) != 0) return;
+            }
+        } else {
+            const char* nf = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+            send_all(fd, nf, std::strlen(nf));
+        }
+    }
+};
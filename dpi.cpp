@@ -1,368 +1,458 @@
 // dpi_check.cpp
-// build: g++ -std=c++23 dpi_check.cpp -lcurl -pthread -O2 -o dpi_check
+// build: cmake -S . -B build && cmake --build build
+//    or: g++ -std=c++23 -Iinclude dpi.cpp src/*.cpp -lcurl -pthread -O2 -o dpi_check
+
+#include "src/context.h"
+#include "src/cpu.h"
+#include "src/dashboard.h"
+#include "src/engine.h"
+#include "src/history.h"
+#include "src/report.h"
+#include "src/suite.h"
 
 #include <curl/curl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
 #include <chrono>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
 #include <iostream>
-#include <mutex>
+#include <map>
+#include <random>
+#include <set>
 #include <string>
-#include <format>
 #include <thread>
+#include <unordered_map>
 #include <vector>
-#include <atomic>
 
 using namespace std::chrono;
-
-static const size_t OK_THRESHOLD_BYTES = 64 * 1024;
-static long TIMEOUT_MS = 5000;
-
-struct Test {
-    std::string id;
-    std::string provider;
-    std::string url;
-    int times{};
-};
-
-struct Result {
-    std::string id;
-    std::string provider;
-    long http_code = 0;
-    std::atomic<size_t> received{0};
-    std::string status;
-    std::string detail;
-    double elapsed_ms = 0.0;
-    bool aborted_by_threshold = false;
-};
-
-std::mutex log_mtx;
-
-void log_write(const std::string& s, bool newline) {
-    std::lock_guard<std::mutex> lk(log_mtx);
-    std::cout << "\r" << s << "\033[K";
-    if (newline) {
-        std::cout << std::endl;
-    } else {
-        std::cout << std::flush;
+using namespace dpi;
+
+static std::string TRACE_PATH;
+static std::string HISTORY_PATH;
+static std::string NDJSON_PATH;
+static std::string DIFF_PATH;
+static long DAEMON_INTERVAL_S = 0;
+static bool DASHBOARD = false;
+static bool QUIET = false;
+static std::string SUITE_URL = "https://raw.githubusercontent.com/hyperion-cs/dpi-checkers/refs/heads/main/ru/tcp-16-20/suite.json";
+
+// Accepts unix seconds or an age such as 90s, 30m, 12h, 7d.
+bool parse_time_arg(const std::string& arg, int64_t& ts_ms) {
+    if (arg.empty()) return false;
+    char unit = arg.back();
+    try {
+        if (std::isdigit(static_cast<unsigned char>(unit))) {
+            ts_ms = std::stoll(arg) * 1000;
+            return true;
+        }
+        int64_t n = std::stoll(arg.substr(0, arg.size() - 1));
+        int64_t mult = unit == 's' ? 1 : unit == 'm' ? 60 : unit == 'h' ? 3600 : unit == 'd' ? 86400 : 0;
+        if (mult == 0) return false;
+        int64_t now_ms = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+        ts_ms = now_ms - n * mult * 1000;
+        return true;
+    } catch (...) {
+        return false;
     }
 }
 
-void log_line(const std::string& s) { log_write(s, true); }
-void log_inline(const std::string& s) { log_write(s, false); }
-
-std::string currentTimestamp() {
-    using namespace std::chrono;
-
-    const auto now = system_clock::now();
-    const auto ms  = duration_cast<milliseconds>(now.time_since_epoch()) % 1s;
-
-    return std::format(
-        "[{:%H:%M:%S}.{:03}]",
-        floor<seconds>(now),
-        ms.count()
-    );
-}
-
-
-
-void log_start(const std::string& id, const std::string& text) {
-    std::string line = std::format("{} {} - {}", currentTimestamp(), id, text);
-    log_inline(line);
-}
-
-void log_msg(const std::string& prefix, const std::string& msg) {
-    std::lock_guard<std::mutex> lk(log_mtx);
-    std::string timestamp = currentTimestamp();
-    std::string output;
-
-    if (!prefix.empty()) {
-        output = std::format("{} {} - {}\n", timestamp, prefix, msg);
-    } else {
-        output = std::format("{} {}\n", timestamp, msg);
+// dpi_check history <file> [--id ID] [--provider P] [--since T] [--until T] [--limit N]
+int history_main(int argc, char** argv) {
+    if (argc < 1) {
+        std::cerr << "usage: dpi_check history <file> [--id ID] [--provider P] [--since T] [--until T] [--limit N]\n";
+        return 2;
     }
-
-    std::cout << output << std::flush;
-}
-
-
-void log_result(const Result& res) {
-    std::string timestamp = currentTimestamp();
-    std::string status = res.status;
-    if (status.size() > 20) status = status.substr(0, 17) + "...";
-
-    std::string output = std::format(
-        "{} {:<15} {:>4} {:>8} {:>10.1f} ms {:<17} {}",
-        timestamp,
-        res.id,
-        res.http_code,
-        res.received.load(),
-        res.elapsed_ms,
-        status,
-        res.detail
-    );
-
-    log_line(output);
-}
-
-static size_t curlWriteToString(void* contents, size_t size, size_t nmemb, void* userp) {
-    size_t totalSize = size * nmemb;
-    std::string* str = static_cast<std::string*>(userp);
-    str->append(static_cast<char*>(contents), totalSize);
-    return totalSize;
-}
-
-bool fetchJson(const std::string& url, std::string& json) { 
-    CURL* curl = curl_easy_init(); 
-    if (!curl) return false; 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str()); 
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteToString); 
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &json); 
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); 
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0"); 
-    CURLcode res = curl_easy_perform(curl); 
-    curl_easy_cleanup(curl); return res == CURLE_OK; 
-}
-
-static inline std::string trim(const std::string& s) {
-    size_t a = s.find_first_not_of(" \t\n\r");
-    size_t b = s.find_last_not_of(" \t\n\r");
-    if (a == std::string::npos) return "";
-    return s.substr(a, b - a + 1);
-}
-
-
-std::string extractTestSuiteArray(const std::string& json) {
-    auto pos = json.find('[');
-    if (pos == std::string::npos) return {};
-
-    size_t depth = 0;
-    size_t start = pos;
-
-    for (size_t i = pos; i < json.size(); ++i) {
-        if (json[i] == '[') depth++;
-        else if (json[i] == ']') {
-            depth--;
-            if (depth == 0) {
-                return json.substr(start, i - start + 1);
+    const std::string path = argv[0];
+    std::string want_id, want_provider;
+    int64_t since_ms = INT64_MIN, until_ms = INT64_MAX;
+    size_t limit = SIZE_MAX;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool ok = i + 1 < argc;
+        if (arg == "--id" && ok) want_id = argv[++i];
+        else if (arg == "--provider" && ok) want_provider = argv[++i];
+        else if (arg == "--since" && ok) ok = parse_time_arg(argv[++i], since_ms);
+        else if (arg == "--until" && ok) ok = parse_time_arg(argv[++i], until_ms);
+        else if (arg == "--limit" && ok) {
+            try {
+                limit = std::stoull(argv[++i]);
+            } catch (...) {
+                ok = false;
             }
         }
+        else ok = false;
+        if (!ok) {
+            std::cerr << "history: bad argument " << arg << "\n";
+            return 2;
+        }
     }
-    return {};
-
-
-}
-
-
-bool parseObject(const std::string& objText, Test& t) {
-auto getString = [&](const std::string& key) -> std::string {
-    std::string pat = "\"" + key + "\":";
-    size_t p = objText.find(pat);
-    if (p == std::string::npos) return "";
-    p = objText.find('"', p + pat.size());
-    if (p == std::string::npos) return "";
-    size_t q = objText.find('"', p + 1);
-    if (q == std::string::npos) return "";
-    return objText.substr(p + 1, q - (p + 1));
-};
 
-auto getInt = [&](const std::string& key) -> int {
-    std::string pat = "\"" + key + "\":";
-    size_t p = objText.find(pat);
-    if (p == std::string::npos) return 0;
-    p += pat.size();
-    while (p < objText.size() && isspace((unsigned char)objText[p])) p++;
-    size_t q = p;
-    while (q < objText.size() && isdigit((unsigned char)objText[q])) q++;
-    return std::stoi(objText.substr(p, q - p));
-};
-
-
-    t.id       = getString("id");
-    t.provider = getString("provider");
-    t.url      = getString("url");
-    t.times    = getInt("times");
+    auto t0 = steady_clock::now();
+    MappedFile records, strings;
+    if (!records.map(path) || !strings.map(path + ".strings") ||
+        records.size < sizeof(HistoryHeader) || strings.size < sizeof(HistoryHeader) ||
+        std::memcmp(records.data, HISTORY_MAGIC, 8) != 0 || std::memcmp(strings.data, HISTORY_STRINGS_MAGIC, 8) != 0) {
+        std::cerr << "history: cannot read " << path << "\n";
+        return 1;
+    }
 
-    return !t.id.empty();
+    // Filters are resolved to string offsets once; the scan compares integers.
+    auto find_offset = [&](const std::string& s) -> int64_t {
+        size_t pos = sizeof(HistoryHeader);
+        while (pos < strings.size) {
+            size_t len = strnlen(strings.data + pos, strings.size - pos);
+            if (len == s.size() && std::memcmp(strings.data + pos, s.data(), len) == 0) return static_cast<int64_t>(pos);
+            pos += len + 1;
+        }
+        return -1;
+    };
+    const int64_t id_off = want_id.empty() ? -2 : find_offset(want_id);
+    const int64_t provider_off = want_provider.empty() ? -2 : find_offset(want_provider);
+
+    const size_t n = (records.size - sizeof(HistoryHeader)) / sizeof(HistoryRecord);
+    std::vector<const HistoryRecord*> matched;
+    if (id_off != -1 && provider_off != -1) {
+        // Newest first so --limit can stop early; printed oldest first below.
+        for (size_t i = n; i-- > 0 && matched.size() < limit;) {
+            HistoryRecord r;
+            std::memcpy(&r, records.data + sizeof(HistoryHeader) + i * sizeof(HistoryRecord), sizeof(r));
+            if (r.ts_ms < since_ms || r.ts_ms > until_ms) continue;
+            if (id_off >= 0 && r.id != id_off) continue;
+            if (provider_off >= 0 && r.provider != provider_off) continue;
+            // Skipped before --limit counts, so a damaged record never takes
+            // the place of a valid one.
+            if (r.verdict >= static_cast<uint8_t>(Verdict::Count) || r.detail >= std::size(DETAIL_TEXT)) continue;
+            matched.push_back(reinterpret_cast<const HistoryRecord*>(records.data + sizeof(HistoryHeader) + i * sizeof(HistoryRecord)));
+        }
+    }
+    auto scan_ms = duration_cast<duration<double, std::milli>>(steady_clock::now() - t0).count();
+
+    // Offsets come from the file, so a truncated strings file must not send
+    // us past its end.
+    auto str = [&](uint32_t off) {
+        return off < strings.size ? std::string_view(strings.data + off, strnlen(strings.data + off, strings.size - off))
+                                  : std::string_view();
+    };
+    for (auto it = matched.rbegin(); it != matched.rend(); ++it) {
+        HistoryRecord r;
+        std::memcpy(&r, *it, sizeof(r));
+        IpAddr ip;
+        ip.family = r.ip_family;
+        std::memcpy(ip.bytes, r.ip, sizeof(ip.bytes));
+        std::string detail = detail_text(static_cast<Detail>(r.detail), r.curl_code);
+        auto tp = system_clock::time_point(milliseconds(r.ts_ms));
+        std::cout << std::format("[{:%Y-%m-%d %H:%M:%S}] {:<15} {:<10} {:>3} {:>4} {:>8} {:>10.1f} ms {:<32} {} {}\n",
+                                 floor<seconds>(tp),
+                                 str(r.id), str(r.provider), r.rep,
+                                 r.http_code, r.kind == static_cast<uint8_t>(ProbeKind::Upload) ? r.uploaded : r.received,
+                                 r.elapsed_ms, VERDICT_TEXT[r.verdict], detail, ip_text(ip));
+    }
+    std::cout << std::format("{} of {} records matched ({:.2f} ms scan)\n", matched.size(), n, scan_ms);
+    return 0;
 }
 
-void parseTestSuiteVector(const std::string& arrayText, std::vector<Test>& out) {
-    size_t i = 0;
-    while (i < arrayText.size()) {
-        auto p = arrayText.find('{', i);
-        if (p == std::string::npos) break;
+// dpi_check merge [--since T] [--until T] [--ndjson out] [NODE=]file...
+//
+// Combines NDJSON or binary history files from several nodes (e.g. the shards
+// of one suite) into one report keyed by node. A result's node is NODE= if
+// given, else the node recorded with it, else the file name.
+int merge_main(int argc, char** argv) {
+    int64_t since_ms = INT64_MIN, until_ms = INT64_MAX;
+    std::string out_path;
+    std::vector<std::pair<std::string, std::string>> inputs;   // node label, path
+    for (int i = 0; i < argc; ++i) {
+        std::string arg = argv[i];
+        bool ok = true;
+        if (arg == "--since" && i + 1 < argc) ok = parse_time_arg(argv[++i], since_ms);
+        else if (arg == "--until" && i + 1 < argc) ok = parse_time_arg(argv[++i], until_ms);
+        else if (arg == "--ndjson" && i + 1 < argc) out_path = argv[++i];
+        else if (arg.starts_with("--")) ok = false;
+        else {
+            size_t eq = arg.find('=');
+            if (eq != std::string::npos && eq < arg.find('/')) inputs.emplace_back(arg.substr(0, eq), arg.substr(eq + 1));
+            else inputs.emplace_back("", arg);
+        }
+        if (!ok) {
+            std::cerr << "merge: bad argument " << arg << "\n";
+            return 2;
+        }
+    }
+    if (inputs.empty()) {
+        std::cerr << "usage: dpi_check merge [--since T] [--until T] [--ndjson out] [NODE=]file...\n";
+        return 2;
+    }
 
-        int depth = 0;
-        size_t start = p;
-        for (size_t j = p; j < arrayText.size(); ++j) {
-            if (arrayText[j] == '{') depth++;
-            else if (arrayText[j] == '}') {
-                depth--;
-                if (depth == 0) {
-                    std::string obj = arrayText.substr(start, j - start + 1);
-                    Test t;
-                    if (parseObject(obj, t)) {
-                        out.push_back(std::move(t));
-                    }
-                    i = j + 1;
-                    break;
-                }
+    struct NodeStats {
+        std::string name;
+        size_t results = 0;
+        size_t verdicts[static_cast<size_t>(Verdict::Count)] = {};
+        std::set<int64_t> rounds;
+    };
+    struct TestStats {
+        std::string provider;
+        std::map<size_t, std::pair<size_t, size_t>> nodes;   // node -> detected, total
+    };
+    std::vector<NodeStats> nodes;
+    std::unordered_map<std::string, size_t> node_index;
+    std::map<std::string, TestStats, std::less<>> tests;
+    std::string merged;
+
+    for (const auto& [label, path] : inputs) {
+        const std::string stem = std::filesystem::path(path).stem().string();
+        bool ok = read_results(path, false, [&](const ResultRow& r) {
+            if (r.ts_ms < since_ms || r.ts_ms > until_ms) return;
+            ResultRow row = r;
+            row.node = !label.empty() ? label : !r.node.empty() ? r.node : stem;
+            auto [it, added] = node_index.try_emplace(std::string(row.node), nodes.size());
+            if (added) {
+                nodes.emplace_back();
+                nodes.back().name = it->first;
             }
+            NodeStats& ns = nodes[it->second];
+            ns.results++;
+            ns.verdicts[static_cast<size_t>(r.verdict)]++;
+            ns.rounds.insert(r.ts_ms);
+
+            auto t = tests.find(r.id);
+            if (t == tests.end()) t = tests.emplace(std::string(r.id), TestStats{std::string(r.provider), {}}).first;
+            auto& [detected, total] = t->second.nodes[it->second];
+            detected += is_detected(r.verdict);
+            total++;
+            if (!out_path.empty()) append_ndjson_row(merged, row);
+        });
+        if (!ok) {
+            std::cerr << "merge: cannot read " << path << "\n";
+            return 1;
         }
-        i++;
     }
-}
 
-void loadTestSuiteFromUrl(std::vector<Test>& tests, const std::string& url) {
-    std::string json;
-    if (!fetchJson(url, json)) return;
-
-    std::string arr = extractTestSuiteArray(json);
-    if (arr.empty()) return;
-
-    tests.clear();
-    parseTestSuiteVector(arr, tests);
-}
-
-
-static size_t write_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
-    size_t real = size * nmemb;
-    Result* res = static_cast<Result*>(userdata);
-    res->received += real;
-    return real;
-}
+    std::cout << std::format("{:<20} {:>8} {:>6} {:>8} {:>8} {:>8} {:>8}\n", "node", "results", "rounds", "detected",
+                             "possibly", "ok", "failed");
+    for (const NodeStats& ns : nodes) {
+        auto count = [&](Verdict v) { return ns.verdicts[static_cast<size_t>(v)]; };
+        std::cout << std::format("{:<20} {:>8} {:>6} {:>8} {:>8} {:>8} {:>8}\n", ns.name, ns.results, ns.rounds.size(),
+                                 count(Verdict::Detected) + count(Verdict::DetectedBlocked),
+                                 count(Verdict::PossiblyDetected), count(Verdict::NotDetected), count(Verdict::Failed));
+    }
+    std::cout << "\n";
+    for (const auto& [id, ts] : tests) {
+        std::string where;
+        size_t detected_nodes = 0;
+        for (const auto& [node, counts] : ts.nodes) {
+            if (counts.first == 0) continue;
+            detected_nodes++;
+            where += std::format("{}{} ({}/{})", where.empty() ? "" : ", ", nodes[node].name, counts.first, counts.second);
+        }
+        std::cout << std::format("{:<15} {:<10} detected on {}/{} nodes{}{}\n", id, ts.provider, detected_nodes,
+                                 ts.nodes.size(), where.empty() ? "" : ": ", where);
+    }
 
-static int xferinfo_cb(void* p, curl_off_t dltotal, curl_off_t dlnow, curl_off_t ultotal, curl_off_t ulnow) {
-    Result* res = static_cast<Result*>(p);
-    if (res->received >= OK_THRESHOLD_BYTES) {
-        res->aborted_by_threshold = true;
-        return 1;
+    if (!out_path.empty()) {
+        std::ofstream f(out_path, std::ios::trunc);
+        if (!(f << merged)) {
+            std::cerr << "merge: cannot write " << out_path << "\n";
+            return 1;
+        }
     }
     return 0;
 }
 
-void worker(const Test& t, int idx, long timeout_ms) {
-    Result res;
-    res.id = (t.times > 1) ? (t.id + "@" + std::to_string(idx)) : t.id;
-    res.provider = t.provider;
+// "i/N" with 1 <= i <= N, stored 0-based.
+static bool parse_shard_arg(const std::string& arg, Config& cfg) {
+    unsigned i = 0, n = 0;
+    char extra;
+    if (std::sscanf(arg.c_str(), "%u/%u%c", &i, &n, &extra) != 2 || n == 0 || i == 0 || i > n) return false;
+    cfg.shard_index = i - 1;
+    cfg.shard_count = n;
+    return true;
+}
 
-    auto t_start = steady_clock::now();
+void run_round(Context& ctx, uint32_t round, HistoryWriter* history);
 
-    CURL* curl = curl_easy_init();
-    if (!curl) {
-        log_msg(res.id, "curl_easy_init failed");
-        return;
+int main(int argc, char** argv) {
+    if (argc > 1 && std::string(argv[1]) == "history") {
+        return history_main(argc - 2, argv + 2);
     }
-
-    std::string url = t.url;
-    if (url.find('?') == std::string::npos) {
-        url += "?t=" + std::to_string((unsigned long)std::hash<std::string>{}(res.id + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())));
-    } else {
-        url += "&t=" + std::to_string((unsigned long)std::hash<std::string>{}(res.id + std::to_string(std::chrono::steady_clock::now().time_since_epoch().count())));
+    if (argc > 1 && std::string(argv[1]) == "merge") {
+        return merge_main(argc - 2, argv + 2);
     }
 
-    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
-    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 0L);
-    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
-    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_cb);
-    curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &res);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &res);
-    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
-    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, timeout_ms);
-    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip, br");
-    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/142.0.0.0 Safari/537.36");
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
-    curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, timeout_ms / 1000);
-
-    log_start(res.id, "Starting request -> " + url);
-    CURLcode rc = curl_easy_perform(curl);
-
-    auto t_end = steady_clock::now();
-    res.elapsed_ms = duration_cast<duration<double, std::milli>>(t_end - t_start).count();
-
-    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &res.http_code);
-
-    switch (rc) {
-    case CURLE_OK:
-        if (res.received >= OK_THRESHOLD_BYTES) {
-            res.status = "Not detected ✅";
-            res.detail = "Received >= threshold";
-        } else {
-            res.status = "Possibly detected ⚠️";
-            res.detail = "Stream ended, data too small";
-        }
-        break;
-
-    case CURLE_OPERATION_TIMEDOUT:
-        if (res.received == 0) {
-            res.status = "Detected* ❗️";
-            res.detail = "Timeout with zero bytes (likely connection blocked)";
+    Context ctx;
+    Config& cfg = ctx.cfg;
+    bool seeded = false;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--trace" && i + 1 < argc) {
+            TRACE_PATH = argv[++i];
+        } else if (arg == "--suite" && i + 1 < argc) {
+            SUITE_URL = argv[++i];
+        } else if (arg == "--ndjson" && i + 1 < argc) {
+            NDJSON_PATH = argv[++i];
+        } else if (arg == "--diff-against" && i + 1 < argc) {
+            DIFF_PATH = argv[++i];
+        } else if (arg == "--history" && i + 1 < argc) {
+            HISTORY_PATH = argv[++i];
+        } else if (arg == "--daemon" && i + 1 < argc) {
+            try {
+                DAEMON_INTERVAL_S = std::stol(argv[++i]);
+            } catch (...) {}
+        } else if (arg == "--shard" && i + 1 < argc) {
+            if (!parse_shard_arg(argv[++i], cfg)) {
+                log_msg(ctx.log, "MAIN", std::format("Bad --shard {}, expected i/N with 1 <= i <= N", argv[i]));
+                return 2;
+            }
+        } else if (arg == "--node" && i + 1 < argc) {
+            cfg.node = argv[++i];
+        } else if (arg == "--stall-ms" && i + 1 < argc) {
+            try {
+                cfg.stall_ms = std::max(0L, std::stol(argv[++i]));
+            } catch (...) {}
+        } else if (arg == "--retries" && i + 1 < argc) {
+            try {
+                cfg.retries = std::max(0, std::stoi(argv[++i]));
+            } catch (...) {}
+        } else if (arg == "--pin-reactors" && i + 1 < argc) {
+            if (!parse_cpu_list(argv[++i], cfg.reactor_cpus)) {
+                log_msg(ctx.log, "MAIN", std::format("Bad --pin-reactors {}, expected a cpu list like 2-5,8", argv[i]));
+                return 2;
+            }
+        } else if (arg == "--pin-logger" && i + 1 < argc) {
+            std::vector<int> cpus;
+            if (!parse_cpu_list(argv[++i], cpus) || cpus.size() != 1) {
+                log_msg(ctx.log, "MAIN", std::format("Bad --pin-logger {}, expected one cpu", argv[i]));
+                return 2;
+            }
+            cfg.logger_cpu = cpus[0];
+        } else if (arg == "--reactors" && i + 1 < argc) {
+            try {
+                cfg.reactors = std::clamp(std::stoi(argv[++i]), 0, 256);
+            } catch (...) {}
+        } else if (arg == "--no-preresolve") {
+            cfg.preresolve = false;
+        } else if (arg == "--dual-stack") {
+            cfg.addr_mode = AddrMode::PerFamily;
+        } else if (arg == "--per-ip") {
+            cfg.addr_mode = AddrMode::PerIp;
+        } else if (arg == "--quiet") {
+            QUIET = true;
+        } else if (arg == "--dashboard") {
+            DASHBOARD = true;
+        } else if (arg == "--h2-multiplex") {
+            cfg.h2_multiplex = true;
+        } else if (arg == "--seed" && i + 1 < argc) {
+            try {
+                cfg.seed = std::stoull(argv[++i], nullptr, 0);
+                seeded = true;
+            } catch (...) {}
+        } else if (arg == "--cache-buster" && i + 1 < argc) {
+            std::string mode = argv[++i];
+            if (mode == "query") cfg.cache_buster = CacheBuster::Query;
+            else if (mode == "header") cfg.cache_buster = CacheBuster::Header;
+            else if (mode == "none") cfg.cache_buster = CacheBuster::None;
+            else log_msg(ctx.log, "MAIN", "Unknown --cache-buster mode: " + mode);
         } else {
-            res.status = "Detected ❗️";
-            res.detail = "Timeout after partial data (read blocked)";
+            try {
+                cfg.timeout_ms = std::stol(arg);
+            } catch (...) {}
         }
-        break;
+    }
+    ctx.trace.enabled = !TRACE_PATH.empty();
+    ctx.trace.track(0, "main");
+    // Pipes and files (cron, log collectors) get plain lines: no progress
+    // lines, no terminal escapes, written out once per logger batch.
+    const bool tty = isatty(STDOUT_FILENO);
+    if (QUIET || !tty) {
+        ctx.log.sink = plain_sink;
+        ctx.log.progress = false;
+    }
+    if (DASHBOARD && (QUIET || !tty)) {
+        log_msg(ctx.log, "MAIN", "--dashboard needs a terminal and no --quiet, printing lines instead");
+        DASHBOARD = false;
+    }
 
-    case CURLE_ABORTED_BY_CALLBACK:
-        if (res.aborted_by_threshold) {
-            res.status = "Not detected ✅";
-            res.detail = "Early abort: threshold reached";
-        } else {
-            res.status = "Detected ❗️";
-            res.detail = "Unexpected abort before threshold";
-        }
-        break;
+    if (!seeded) {
+        cfg.seed = splitmix64(std::random_device{}() ^ static_cast<uint64_t>(system_clock::now().time_since_epoch().count()));
+    }
 
-    default:
-        {
-            std::ostringstream ss;
-            ss << "curl_error=" << rc << " (" << curl_easy_strerror(rc) << ")";
-            res.status = "Failed to complete detection ⚠️";
-            res.detail = ss.str();
-        }
-        break;
-}
+    curl_global_init(CURL_GLOBAL_DEFAULT);
+    if (cfg.h2_multiplex && !(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP2)) {
+        log_msg(ctx.log, "MAIN", "libcurl has no HTTP/2 support, --h2-multiplex will fall back to HTTP/1.1");
+    }
 
-{
-    std::ostringstream summary;
-    summary << "HTTP " << res.http_code
-            << " | bytes=" << res.received.load()
-            << " | elapsed=" << std::fixed << std::setprecision(1) << res.elapsed_ms << " ms"
-            << " | result=" << res.status
-            << " | " << res.detail;
+    HistoryWriter history;
+    if (!HISTORY_PATH.empty() && !history.open(HISTORY_PATH, cfg.node)) {
+        log_msg(ctx.log, "MAIN", std::format("Cannot open history file {}: {}", HISTORY_PATH, std::strerror(errno)));
+        return 1;
+    }
 
-    log_result(res);
-}
-    curl_easy_cleanup(curl);
+    for (uint32_t round = 0;; ++round) {
+        auto round_start = steady_clock::now();
+        run_round(ctx, round, HISTORY_PATH.empty() ? nullptr : &history);
+        if (DAEMON_INTERVAL_S <= 0) break;
+        std::this_thread::sleep_until(round_start + seconds(DAEMON_INTERVAL_S));
+    }
 
+    free_resolved(ctx.tests);
+    free_handles(ctx);
+    curl_global_cleanup();
+    return 0;
 }
 
-int main(int argc, char** argv) {
-std::vector<Test> tests = {};
-
-if (argc > 1) {
-        try {
-            TIMEOUT_MS = std::stol(argv[1]);
-        } catch (...) {}
+// One pass over the suite: load, resolve, probe, report, record.
+void run_round(Context& ctx, uint32_t round, HistoryWriter* history) {
+    ctx.trace.clear();      // each --daemon round rewrites the file with its own trace
+    const int64_t round_ts_ms = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+    if (!loadTestSuiteFromUrl(ctx, SUITE_URL)) {
+        free_resolved(ctx.tests);
+        ctx.tests.clear();
+    }
+    {
+        Dashboard dashboard(ctx);
+        if (DASHBOARD) dashboard.start();
+        run_suite(ctx);
     }
 
-    curl_global_init(CURL_GLOBAL_DEFAULT);
-    loadTestSuiteFromUrl(tests, "https://raw.githubusercontent.com/hyperion-cs/dpi-checkers/refs/heads/main/ru/tcp-16-20/suite.json");
-    
-
-
-
-    std::vector<std::thread> workers;
-    for (const auto& t : tests) {
-        for (int i = 0; i < t.times; ++i) {
-            workers.emplace_back(worker, t, i, TIMEOUT_MS);
+    if (!NDJSON_PATH.empty() && !append_ndjson(ctx, NDJSON_PATH, round_ts_ms, round)) {
+        log_msg(ctx.log, "MAIN", "Failed to write " + NDJSON_PATH);
+    }
+    if (!DIFF_PATH.empty()) {
+        // The first round compares against the given file, later daemon
+        // rounds against the previous round.
+        static PriorIndex prior;
+        if (round == 0) {
+            auto t0 = steady_clock::now();
+            if (load_prior(DIFF_PATH, prior)) {
+                log_msg(ctx.log, "DIFF", std::format("Loaded {} prior results from {} in {:.1f} ms", prior.size(), DIFF_PATH,
+                                                     duration_cast<duration<double, std::milli>>(steady_clock::now() - t0).count()));
+            } else {
+                log_msg(ctx.log, "DIFF", "Cannot read " + DIFF_PATH);
+            }
         }
+        TraceScope span(ctx.trace, 0, "main", "diff");
+        log_diff(ctx, prior);
+        index_results(ctx, prior);
     }
 
-    for (auto &th : workers) {
-        if (th.joinable()) th.join();
+    if (history) {
+        TraceScope span(ctx.trace, 0, "main", "history_append");
+        if (!history->append(ctx.strings, ctx.store, round_ts_ms, round)) {
+            log_msg(ctx.log, "MAIN", std::format("Failed to append to history: {}", std::strerror(errno)));
+        }
     }
 
-    curl_global_cleanup();
-    log_msg("MAIN", "All tests finished.");
-    return 0;
+    if (ctx.trace.enabled) {
+        if (ctx.trace.write(TRACE_PATH)) {
+            log_msg(ctx.log, "MAIN", "Trace written to " + TRACE_PATH);
+        } else {
+            log_msg(ctx.log, "MAIN", "Failed to write trace to " + TRACE_PATH);
+        }
+    }
 }
@@ -0,0 +1,156 @@
+/* dpicheck.h - C API of the tcp 16-20 DPI checker
+ *
+ * A context owns the options, the loaded suite and the results of its last
+ * run. Runs are asynchronous: dpi_submit() starts probing on a background
+ * thread and returns, results are delivered through the callback as probes
+ * finish and stay readable with dpi_get_result() afterwards. A context runs
+ * one suite at a time; use several contexts for concurrent runs.
+ *
+ * Functions taking a context are not thread-safe against each other, except
+ * dpi_wait(), which may be called from any thread.
+ */
+#ifndef DPICHECK_H
+#define DPICHECK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#  define DPI_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#  define DPI_API __attribute__((visibility("default")))
+#else
+#  define DPI_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define DPI_VERSION_MAJOR 1
+#define DPI_VERSION_MINOR 4
+
+typedef struct dpi_context dpi_context;
+
+typedef enum dpi_status {
+    DPI_OK = 0,
+    DPI_ERR_INVALID = 1,   /* bad argument or option value */
+    DPI_ERR_BUSY = 2,      /* a run is in progress */
+    DPI_ERR_FETCH = 3,     /* suite could not be downloaded */
+    DPI_ERR_PARSE = 4,     /* suite has no test array */
+    DPI_ERR_TIMEOUT = 5,   /* dpi_wait() timed out */
+    DPI_ERR_IO = 6,        /* file could not be written */
+    DPI_ERR_NOMEM = 7
+} dpi_status;
+
+typedef enum dpi_option {
+    DPI_OPT_TIMEOUT_MS = 1,    /* per-probe timeout, default 5000 */
+    DPI_OPT_SEED = 2,          /* cache-buster / payload seed, default random */
+    DPI_OPT_CACHE_BUSTER = 3,  /* dpi_cache_buster, default DPI_CACHE_BUSTER_QUERY */
+    DPI_OPT_H2_MULTIPLEX = 4,  /* 0/1: repetitions as streams of one connection */
+    DPI_OPT_ADDR_MODE = 5,     /* dpi_addr_mode, default DPI_ADDR_DEFAULT */
+    DPI_OPT_PRERESOLVE = 6,    /* 0/1, default 1 */
+    DPI_OPT_TRACE = 7,         /* 0/1: collect a Chrome trace, see dpi_write_trace() */
+    DPI_OPT_SHARD_COUNT = 8,   /* split the suite into N shards by test id, default 1 */
+    DPI_OPT_SHARD_INDEX = 9,   /* 0-based shard the next suite load keeps, default 0 */
+    DPI_OPT_RETRIES = 10,      /* extra attempts after a failed connect, default 0 */
+    DPI_OPT_REACTORS = 11,     /* event-loop threads, 0 = one per core (or pinned cpu), default 1 */
+    DPI_OPT_STALL_MS = 12      /* end a probe after this long without progress, 0 = off (default) */
+} dpi_option;
+
+typedef enum dpi_cache_buster {
+    DPI_CACHE_BUSTER_QUERY = 0,
+    DPI_CACHE_BUSTER_HEADER = 1,
+    DPI_CACHE_BUSTER_NONE = 2
+} dpi_cache_buster;
+
+typedef enum dpi_addr_mode {
+    DPI_ADDR_DEFAULT = 0,
+    DPI_ADDR_PER_FAMILY = 1,
+    DPI_ADDR_PER_IP = 2
+} dpi_addr_mode;
+
+typedef enum dpi_verdict {
+    DPI_NOT_DETECTED = 0,
+    DPI_POSSIBLY_DETECTED = 1,
+    DPI_DETECTED_BLOCKED = 2,
+    DPI_DETECTED = 3,
+    DPI_FAILED = 4
+} dpi_verdict;
+
+typedef enum dpi_log_kind {
+    DPI_LOG_LINE = 0,      /* a finished status line */
+    DPI_LOG_PROGRESS = 1,  /* a progress line the next one replaces */
+    DPI_LOG_MESSAGE = 2
+} dpi_log_kind;
+
+/* One probe result. Set size to sizeof(dpi_result) before calling
+ * dpi_get_result(); fields added later are only filled when they fit.
+ * String pointers stay valid until the next dpi_submit(), dpi_load_*() or
+ * dpi_context_free(). */
+typedef struct dpi_result {
+    size_t size;
+    const char* id;          /* display id: id[@rep][/ip] */
+    const char* test_id;
+    const char* provider;
+    const char* ip;          /* address actually connected to, "" if none */
+    uint32_t rep;
+    int upload;              /* 1 for upload freeze probes */
+    long http_code;
+    uint64_t received;
+    uint64_t uploaded;       /* acknowledged upload bytes */
+    double elapsed_ms;
+    double stall_ms;
+    int curl_code;
+    dpi_verdict verdict;
+    const char* detail;      /* human-readable reason */
+} dpi_result;
+
+typedef void (*dpi_result_cb)(dpi_context* ctx, size_t index, void* user);
+typedef void (*dpi_log_cb)(dpi_log_kind kind, const char* text, void* user);
+
+/* Returns NULL if libcurl cannot be initialized. */
+DPI_API dpi_context* dpi_context_new(void);
+/* Waits for a running suite to finish, then releases everything. */
+DPI_API void dpi_context_free(dpi_context* ctx);
+
+DPI_API dpi_status dpi_set_option(dpi_context* ctx, dpi_option opt, long long value);
+/* Log output is off by default. Pass NULL to turn it off again. During a run
+ * the callback is called from a logger thread, one line at a time. */
+DPI_API dpi_status dpi_set_log_callback(dpi_context* ctx, dpi_log_cb cb, void* user);
+
+/* Pins reactor i to the i-th CPU of reactor_cpus, a Linux cpulist such as
+ * "2-5,8" (reused round-robin; with DPI_OPT_REACTORS 0 there is one reactor
+ * per listed CPU), and the logger thread to logger_cpu. NULL or "" and -1
+ * leave the threads unpinned. Placement is reported in the log and trace. */
+DPI_API dpi_status dpi_set_pinning(dpi_context* ctx, const char* reactor_cpus, int logger_cpu);
+
+/* With DPI_OPT_SHARD_COUNT > 1 only the tests of DPI_OPT_SHARD_INDEX are
+ * kept; an index outside the count is DPI_ERR_INVALID. */
+DPI_API dpi_status dpi_load_suite_url(dpi_context* ctx, const char* url);
+DPI_API dpi_status dpi_load_suite_json(dpi_context* ctx, const char* json, size_t len);
+DPI_API size_t dpi_suite_size(const dpi_context* ctx);
+
+/* Starts probing the loaded suite and returns immediately. cb, if set, is
+ * called from one of the run's event-loop threads once per finished probe,
+ * never concurrently with itself. */
+DPI_API dpi_status dpi_submit(dpi_context* ctx, dpi_result_cb cb, void* user);
+/* Blocks until the run finishes. timeout_ms < 0 waits forever. */
+DPI_API dpi_status dpi_wait(dpi_context* ctx, long timeout_ms);
+
+/* Valid inside the result callback (for the reported index) and after
+ * dpi_wait() returned DPI_OK. */
+DPI_API size_t dpi_result_count(const dpi_context* ctx);
+DPI_API dpi_status dpi_get_result(const dpi_context* ctx, size_t index, dpi_result* out);
+
+/* Writes the trace of the most recent dpi_submit() run. */
+DPI_API dpi_status dpi_write_trace(dpi_context* ctx, const char* path);
+
+DPI_API const char* dpi_version(void);
+DPI_API const char* dpi_strerror(dpi_status status);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DPICHECK_H */
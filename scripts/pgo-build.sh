@@ -0,0 +1,102 @@
+#!/usr/bin/env bash
+# pgo-build.sh - profile-guided optimized build of dpi_check and libdpicheck
+#
+# usage: scripts/pgo-build.sh <out-dir> [extra cmake args...]
+#
+#   1. instrumented build (DPI_PGO=GENERATE) in <out-dir>/build
+#   2. training: bench_loopback, bench_results and dpi_check against the
+#      loopback server; no network needed
+#   3. optimized rebuild (DPI_PGO=USE, LTO unless LTO=0) in the same
+#      directory: GCC names profiles after the object path
+#   4. optional: BOLT=1 post-link layout of dpi_check with llvm-bolt,
+#      written to <out-dir>/dpi_check.bolt
+#
+# COMPARE=1 also builds <out-dir>/base without PGO and prints the loopback
+# benchmark for both. Works with GCC and Clang (needs llvm-profdata).
+
+set -euo pipefail
+
+if [ $# -lt 1 ]; then
+    sed -n '2,16p' "$0" | sed 's/^# \{0,1\}//'
+    exit 2
+fi
+
+SRC=$(cd "$(dirname "$0")/.." && pwd)
+OUT=$(mkdir -p "$1" && cd "$1" && pwd)
+shift
+PROFILE="$OUT/profile"
+JOBS=${JOBS:-$(nproc)}
+LTO=${LTO:-1}
+LTO_FLAG=$([ "$LTO" = 1 ] && echo ON || echo OFF)
+
+configure() {
+    local dir=$1
+    shift
+    cmake -S "$SRC" -B "$dir" -DCMAKE_BUILD_TYPE=Release -DDPI_PGO_DIR="$PROFILE" "$@"
+}
+
+# The same workload trains the profile and, with BOLT=1, the layout.
+train() {
+    local bin=$1 check=$2 work="$OUT/train"
+    rm -rf "$work"
+    mkdir -p "$work"
+
+    "$bin/bench_loopback" --rounds 10 --times 8
+    "$bin/bench_results" --results 50000 --dir "$work"
+
+    "$bin/bench_loopback" --serve "$work/suite.json" --seconds 120 --times 4 &
+    local server=$!
+    for _ in $(seq 50); do [ -f "$work/suite.json" ] && break; sleep 0.1; done
+    for round in 1 2 3; do
+        "$check" 300 --suite "file://$work/suite.json" --seed "$round" \
+            --ndjson "$work/r.ndjson" --history "$work/h.dpih" --diff-against "$work/r.ndjson" >/dev/null
+    done
+    "$check" 300 --suite "file://$work/suite.json" --per-ip --h2-multiplex >/dev/null
+    "$check" history "$work/h.dpih" --limit 20 >/dev/null
+    kill "$server"
+    wait "$server" 2>/dev/null || true
+}
+
+BUILD="$OUT/build"
+
+echo "== instrumented build"
+rm -rf "$PROFILE"
+configure "$BUILD" -DDPI_PGO=GENERATE -DDPI_LTO=OFF "$@"
+cmake --build "$BUILD" -j "$JOBS"
+
+echo "== training"
+train "$BUILD" "$BUILD/dpi_check"
+if compgen -G "$PROFILE/*.profraw" >/dev/null; then
+    llvm-profdata merge -o "$PROFILE/default.profdata" "$PROFILE"/*.profraw
+fi
+
+echo "== optimized build"
+BOLT_FLAGS=()
+if [ "${BOLT:-0}" = 1 ]; then
+    BOLT_FLAGS=(-DCMAKE_EXE_LINKER_FLAGS=-Wl,--emit-relocs)
+fi
+configure "$BUILD" -DDPI_PGO=USE -DDPI_LTO="$LTO_FLAG" "${BOLT_FLAGS[@]}" "$@"
+cmake --build "$BUILD" -j "$JOBS"
+
+if [ "${BOLT:-0}" = 1 ]; then
+    echo "== BOLT"
+    llvm-bolt "$BUILD/dpi_check" -instrument -instrumentation-file="$OUT/bolt.fdata" \
+        -o "$OUT/dpi_check.inst"
+    rm -f "$OUT/bolt.fdata"
+    train "$BUILD" "$OUT/dpi_check.inst"
+    llvm-bolt "$BUILD/dpi_check" -data="$OUT/bolt.fdata" -o "$OUT/dpi_check.bolt" \
+        -reorder-blocks=ext-tsp -reorder-functions=hfsort -split-functions -split-all-cold -icf=1
+fi
+
+if [ "${COMPARE:-0}" = 1 ]; then
+    echo "== baseline build"
+    configure "$OUT/base" -DDPI_PGO=OFF -DDPI_LTO="$LTO_FLAG" "$@"
+    cmake --build "$OUT/base" -j "$JOBS"
+    for b in base build; do
+        echo "-- $b"
+        "$OUT/$b/bench_loopback" --rounds 20
+        "$OUT/$b/bench_results"
+    done
+fi
+
+echo "== done: $BUILD/dpi_check$([ "${BOLT:-0}" = 1 ] && echo ", $OUT/dpi_check.bolt")"
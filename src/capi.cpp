@@ -0,0 +1,314 @@
+// capi.cpp - C API over dpi::Context
+
+#include "dpicheck.h"
+#include "cpu.h"
+#include "engine.h"
+#include "suite.h"
+
+#include <chrono>
+#include <cstdint>
+#include <condition_variable>
+#include <format>
+#include <mutex>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct dpi_context {
+    dpi::Context ctx;
+
+    std::thread runner;
+    std::mutex run_mtx;
+    std::condition_variable run_cv;
+    bool running = false;
+
+    dpi_result_cb result_cb = nullptr;
+    void* result_user = nullptr;
+    dpi_log_cb log_cb = nullptr;
+    void* log_user = nullptr;
+
+    // Backing storage for the strings handed out by dpi_get_result.
+    std::mutex text_mtx;
+    std::vector<std::string> ids, ips, details;
+};
+
+namespace {
+
+// curl_global_init is not thread-safe and must run once per process, no
+// matter how many contexts come and go.
+std::mutex global_mtx;
+int global_refs = 0;
+
+bool global_acquire() {
+    std::lock_guard<std::mutex> lk(global_mtx);
+    if (global_refs == 0 && curl_global_init(CURL_GLOBAL_DEFAULT) != CURLE_OK) return false;
+    global_refs++;
+    return true;
+}
+
+void global_release() {
+    std::lock_guard<std::mutex> lk(global_mtx);
+    if (--global_refs == 0) curl_global_cleanup();
+}
+
+bool is_running(dpi_context* c) {
+    std::lock_guard<std::mutex> lk(c->run_mtx);
+    return c->running;
+}
+
+void log_trampoline(dpi::LogKind kind, const char* text, void* user) {
+    auto* c = static_cast<dpi_context*>(user);
+    dpi_log_kind k = kind == dpi::LogKind::Line ? DPI_LOG_LINE
+                   : kind == dpi::LogKind::Inline ? DPI_LOG_PROGRESS : DPI_LOG_MESSAGE;
+    c->log_cb(k, text, c->log_user);
+}
+
+void reset_text(dpi_context* c) {
+    std::lock_guard<std::mutex> lk(c->text_mtx);
+    c->ids.clear();
+    c->ips.clear();
+    c->details.clear();
+}
+
+} // namespace
+
+extern "C" {
+
+dpi_context* dpi_context_new(void) {
+    if (!global_acquire()) return nullptr;
+    auto* c = new (std::nothrow) dpi_context;
+    if (!c) {
+        global_release();
+        return nullptr;
+    }
+    c->ctx.log.sink = nullptr;
+    c->ctx.log.flush = nullptr;
+    c->ctx.cfg.seed = dpi::splitmix64(std::random_device{}() ^
+                                      static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count()));
+    return c;
+}
+
+void dpi_context_free(dpi_context* c) {
+    if (!c) return;
+    dpi_wait(c, -1);
+    if (c->runner.joinable()) c->runner.join();
+    delete c;
+    global_release();
+}
+
+dpi_status dpi_set_option(dpi_context* c, dpi_option opt, long long value) {
+    if (!c) return DPI_ERR_INVALID;
+    if (is_running(c)) return DPI_ERR_BUSY;
+    dpi::Config& cfg = c->ctx.cfg;
+    switch (opt) {
+    case DPI_OPT_TIMEOUT_MS:
+        if (value <= 0) return DPI_ERR_INVALID;
+        cfg.timeout_ms = static_cast<long>(value);
+        break;
+    case DPI_OPT_SEED:
+        cfg.seed = static_cast<uint64_t>(value);
+        break;
+    case DPI_OPT_CACHE_BUSTER:
+        if (value < DPI_CACHE_BUSTER_QUERY || value > DPI_CACHE_BUSTER_NONE) return DPI_ERR_INVALID;
+        cfg.cache_buster = static_cast<dpi::CacheBuster>(value);
+        break;
+    case DPI_OPT_H2_MULTIPLEX:
+        cfg.h2_multiplex = value != 0;
+        break;
+    case DPI_OPT_ADDR_MODE:
+        if (value < DPI_ADDR_DEFAULT || value > DPI_ADDR_PER_IP) return DPI_ERR_INVALID;
+        cfg.addr_mode = static_cast<dpi::AddrMode>(value);
+        break;
+    case DPI_OPT_PRERESOLVE:
+        cfg.preresolve = value != 0;
+        break;
+    case DPI_OPT_TRACE:
+        c->ctx.trace.enabled = value != 0;
+        c->ctx.trace.track(0, "main");
+        break;
+    case DPI_OPT_RETRIES:
+        if (value < 0 || value > 16) return DPI_ERR_INVALID;
+        cfg.retries = static_cast<int>(value);
+        break;
+    case DPI_OPT_STALL_MS:
+        if (value < 0 || value > 3600000) return DPI_ERR_INVALID;
+        cfg.stall_ms = static_cast<long>(value);
+        break;
+    case DPI_OPT_REACTORS:
+        if (value < 0 || value > 256) return DPI_ERR_INVALID;
+        cfg.reactors = static_cast<int>(value);
+        break;
+    case DPI_OPT_SHARD_COUNT:
+        if (value < 1 || value > UINT32_MAX) return DPI_ERR_INVALID;
+        cfg.shard_count = static_cast<uint32_t>(value);
+        break;
+    case DPI_OPT_SHARD_INDEX:
+        if (value < 0 || value > UINT32_MAX) return DPI_ERR_INVALID;
+        cfg.shard_index = static_cast<uint32_t>(value);
+        break;
+    default:
+        return DPI_ERR_INVALID;
+    }
+    return DPI_OK;
+}
+
+dpi_status dpi_set_log_callback(dpi_context* c, dpi_log_cb cb, void* user) {
+    if (!c) return DPI_ERR_INVALID;
+    if (is_running(c)) return DPI_ERR_BUSY;
+    c->log_cb = cb;
+    c->log_user = user;
+    c->ctx.log.sink = cb ? log_trampoline : nullptr;
+    c->ctx.log.user = c;
+    return DPI_OK;
+}
+
+dpi_status dpi_set_pinning(dpi_context* c, const char* reactor_cpus, int logger_cpu) {
+    if (!c || logger_cpu < -1 || logger_cpu >= CPU_SETSIZE) return DPI_ERR_INVALID;
+    if (is_running(c)) return DPI_ERR_BUSY;
+    std::vector<int> cpus;
+    if (reactor_cpus && *reactor_cpus && !dpi::parse_cpu_list(reactor_cpus, cpus)) return DPI_ERR_INVALID;
+    c->ctx.cfg.reactor_cpus = std::move(cpus);
+    c->ctx.cfg.logger_cpu = logger_cpu;
+    return DPI_OK;
+}
+
+dpi_status dpi_load_suite_url(dpi_context* c, const char* url) {
+    if (!c || !url || c->ctx.cfg.shard_index >= c->ctx.cfg.shard_count) return DPI_ERR_INVALID;
+    if (is_running(c)) return DPI_ERR_BUSY;
+    std::string json;
+    {
+        dpi::TraceScope span(c->ctx.trace, 0, "suite", "suite_fetch");
+        if (!dpi::fetchJson(url, json)) return DPI_ERR_FETCH;
+    }
+    if (!dpi::loadTestSuiteFromJson(c->ctx, json)) return DPI_ERR_PARSE;
+    reset_text(c);
+    return DPI_OK;
+}
+
+dpi_status dpi_load_suite_json(dpi_context* c, const char* json, size_t len) {
+    if (!c || !json || c->ctx.cfg.shard_index >= c->ctx.cfg.shard_count) return DPI_ERR_INVALID;
+    if (is_running(c)) return DPI_ERR_BUSY;
+    if (!dpi::loadTestSuiteFromJson(c->ctx, std::string(json, len))) return DPI_ERR_PARSE;
+    reset_text(c);
+    return DPI_OK;
+}
+
+size_t dpi_suite_size(const dpi_context* c) {
+    return c ? c->ctx.tests.size() : 0;
+}
+
+dpi_status dpi_submit(dpi_context* c, dpi_result_cb cb, void* user) {
+    if (!c) return DPI_ERR_INVALID;
+    {
+        std::lock_guard<std::mutex> lk(c->run_mtx);
+        if (c->running) return DPI_ERR_BUSY;
+        c->running = true;
+    }
+    if (c->runner.joinable()) c->runner.join();
+    reset_text(c);
+
+    c->result_cb = cb;
+    c->result_user = user;
+    if (cb) {
+        c->ctx.on_result = [c](dpi::Context&, size_t slot) { c->result_cb(c, slot, c->result_user); };
+    } else {
+        c->ctx.on_result = nullptr;
+    }
+
+    c->ctx.trace.clear();
+    try {
+        c->runner = std::thread([c] {
+            dpi::run_suite(c->ctx);
+            std::lock_guard<std::mutex> lk(c->run_mtx);
+            c->running = false;
+            c->run_cv.notify_all();
+        });
+    } catch (...) {
+        std::lock_guard<std::mutex> lk(c->run_mtx);
+        c->running = false;
+        return DPI_ERR_NOMEM;
+    }
+    return DPI_OK;
+}
+
+dpi_status dpi_wait(dpi_context* c, long timeout_ms) {
+    if (!c) return DPI_ERR_INVALID;
+    std::unique_lock<std::mutex> lk(c->run_mtx);
+    if (timeout_ms < 0) {
+        c->run_cv.wait(lk, [c] { return !c->running; });
+        return DPI_OK;
+    }
+    return c->run_cv.wait_for(lk, std::chrono::milliseconds(timeout_ms), [c] { return !c->running; })
+        ? DPI_OK : DPI_ERR_TIMEOUT;
+}
+
+size_t dpi_result_count(const dpi_context* c) {
+    return c ? c->ctx.store.count : 0;
+}
+
+dpi_status dpi_get_result(const dpi_context* cc, size_t index, dpi_result* out) {
+    if (!cc || !out || out->size < offsetof(dpi_result, detail) + sizeof(out->detail)) return DPI_ERR_INVALID;
+    auto* c = const_cast<dpi_context*>(cc);
+    const dpi::Context& ctx = c->ctx;
+    const dpi::ResultStore& store = ctx.store;
+    if (index >= store.count) return DPI_ERR_INVALID;
+
+    const dpi::Test& t = ctx.tests[store.test[index]];
+    std::lock_guard<std::mutex> lk(c->text_mtx);
+    if (c->ids.size() != store.count) {
+        c->ids.assign(store.count, {});
+        c->ips.assign(store.count, {});
+        c->details.assign(store.count, {});
+    }
+    if (c->ids[index].empty()) {
+        c->ids[index] = dpi::result_id(ctx.strings, t, store, index);
+        c->ips[index] = dpi::ip_text(store.ip[index]);
+        c->details[index] = dpi::detail_text(store, index);
+    }
+
+    out->id = c->ids[index].c_str();
+    out->test_id = ctx.strings.str(t.id).c_str();
+    out->provider = ctx.strings.str(t.provider).c_str();
+    out->ip = c->ips[index].c_str();
+    out->rep = store.rep[index];
+    out->upload = store.kind[index] == dpi::ProbeKind::Upload;
+    out->http_code = store.http_code[index];
+    out->received = store.received[index];
+    out->uploaded = store.uploaded[index];
+    out->elapsed_ms = store.elapsed_ms[index];
+    out->stall_ms = store.stall_ms[index];
+    out->curl_code = store.curl_code[index];
+    out->verdict = static_cast<dpi_verdict>(store.verdict[index]);
+    out->detail = c->details[index].c_str();
+    return DPI_OK;
+}
+
+dpi_status dpi_write_trace(dpi_context* c, const char* path) {
+    if (!c || !path) return DPI_ERR_INVALID;
+    if (is_running(c)) return DPI_ERR_BUSY;
+    return c->ctx.trace.write(path) ? DPI_OK : DPI_ERR_IO;
+}
+
+const char* dpi_version(void) {
+    static const std::string v = std::format("{}.{} ({})", DPI_VERSION_MAJOR, DPI_VERSION_MINOR,
+                                             curl_version_info(CURLVERSION_NOW)->version);
+    return v.c_str();
+}
+
+const char* dpi_strerror(dpi_status status) {
+    switch (status) {
+    case DPI_OK:          return "ok";
+    case DPI_ERR_INVALID: return "invalid argument";
+    case DPI_ERR_BUSY:    return "a run is in progress";
+    case DPI_ERR_FETCH:   return "suite download failed";
+    case DPI_ERR_PARSE:   return "suite has no test array";
+    case DPI_ERR_TIMEOUT: return "timed out";
+    case DPI_ERR_IO:      return "i/o error";
+    case DPI_ERR_NOMEM:   return "out of memory";
+    }
+    return "unknown error";
+}
+
+} // extern "C"
@@ -0,0 +1,77 @@
+// context.h - one probing session: options, suite, results
+#pragma once
+
+#include "log.h"
+#include "progress.h"
+#include "trace.h"
+#include "types.h"
+
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dpi {
+
+enum class CacheBuster { Query, Header, None };
+// PerFamily probes one address per family, PerIp every resolved address.
+enum class AddrMode { Default, PerFamily, PerIp };
+
+struct Config {
+    long timeout_ms = 5000;
+    long stall_ms = 0;  // --stall-ms: end a probe that moved no data this long, 0 = off
+    CacheBuster cache_buster = CacheBuster::Query;
+    uint64_t seed = 0;
+    bool h2_multiplex = false;
+    AddrMode addr_mode = AddrMode::Default;
+    bool preresolve = true;
+    int retries = 0;    // extra attempts after a failed connect, see retryable()
+    int reactors = 1;   // event-loop threads; 0 means one per core
+    // --pin-reactors: reactor i runs on reactor_cpus[i % size]; with
+    // reactors == 0 there is one reactor per listed CPU.
+    std::vector<int> reactor_cpus;
+    int logger_cpu = -1;    // --pin-logger
+    // --shard i/N: only the tests owned by shard_index (0-based) of
+    // shard_count are loaded, see shard_of().
+    uint32_t shard_index = 0;
+    uint32_t shard_count = 1;
+    std::string node;   // --node: tags exported results for merging
+};
+
+struct Reactor;     // engine.cpp
+
+// Everything a run needs that used to be process-wide: the options, the
+// loaded suite, the results of the last run and the log/trace plumbing.
+// Several contexts can live in one process; a context runs one suite at a time.
+struct Context {
+    Config cfg;
+    StringTable strings;
+    std::vector<Test> tests;
+    ResultStore store;
+    Logger log;
+    Tracer trace;
+    Progress progress;
+    // The event loops of the last run with their pooled easy handles and
+    // coroutine frames, reused by the next run.
+    std::vector<std::unique_ptr<Reactor>> reactors;
+
+    // Called once per finished probe from the reactor threads, serialized by
+    // result_mtx.
+    std::function<void(Context&, size_t slot)> on_result;
+    std::mutex result_mtx;
+
+    // Shared header lists and upload payload, rebuilt by run_suite. Upload
+    // probes suppress "Expect: 100-continue" so the body starts flowing at once.
+    curl_slist* cache_buster_headers = nullptr;
+    curl_slist* upload_headers = nullptr;
+    char upload_payload[UPLOAD_CHUNK_BYTES] = {};
+
+    Context();
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+    ~Context();
+};
+
+} // namespace dpi
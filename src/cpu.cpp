@@ -0,0 +1,79 @@
+// cpu.cpp - CPU lists and thread pinning
+
+#include "cpu.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <charconv>
+#include <format>
+
+namespace dpi {
+
+static bool parse_cpu(std::string_view s, int& cpu) {
+    const char* end = s.data() + s.size();
+    auto [p, ec] = std::from_chars(s.data(), end, cpu);
+    return ec == std::errc() && p == end && cpu >= 0 && cpu < CPU_SETSIZE;
+}
+
+bool parse_cpu_list(std::string_view text, std::vector<int>& out) {
+    out.clear();
+    while (!text.empty()) {
+        const size_t comma = text.find(',');
+        const std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view{} : text.substr(comma + 1);
+
+        const size_t dash = item.find('-');
+        int first = 0, last = 0;
+        if (!parse_cpu(item.substr(0, dash), first)) return false;
+        last = first;
+        if (dash != std::string_view::npos && (!parse_cpu(item.substr(dash + 1), last) || last < first)) return false;
+        for (int c = first; c <= last; ++c) out.push_back(c);
+    }
+    return !out.empty();
+}
+
+std::string cpu_list_text(const std::vector<int>& cpus) {
+    std::string s;
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) ++j;
+        if (!s.empty()) s += ',';
+        s += j > i ? std::format("{}-{}", cpus[i], cpus[j]) : std::format("{}", cpus[i]);
+        i = j;
+    }
+    return s;
+}
+
+Placement pin_current_thread(int cpu) {
+    Placement p;
+    p.requested = cpu;
+    if (cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        p.pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+    }
+    unsigned c = 0, n = 0;
+    if (getcpu(&c, &n) == 0) {
+        p.cpu = static_cast<int>(c);
+        p.node = static_cast<int>(n);
+    }
+    return p;
+}
+
+AffinityScope::AffinityScope() {
+    CPU_ZERO(&saved);
+    valid = pthread_getaffinity_np(pthread_self(), sizeof(saved), &saved) == 0;
+}
+
+AffinityScope::~AffinityScope() {
+    if (valid) pthread_setaffinity_np(pthread_self(), sizeof(saved), &saved);
+}
+
+std::string placement_text(const Placement& p) {
+    if (p.pinned) return std::format("cpu {} node {}", p.cpu, p.node);
+    if (p.requested >= 0) return std::format("cpu {} refused, unpinned", p.requested);
+    return "unpinned";
+}
+
+} // namespace dpi
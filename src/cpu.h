@@ -0,0 +1,44 @@
+// cpu.h - CPU lists and thread pinning
+#pragma once
+
+#include <sched.h>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dpi {
+
+// Parses a Linux cpulist ("2-5,8,10-11") into CPU numbers in the given
+// order. Returns false on malformed input or CPUs beyond CPU_SETSIZE.
+bool parse_cpu_list(std::string_view text, std::vector<int>& out);
+std::string cpu_list_text(const std::vector<int>& cpus);
+
+// Where a thread was asked to run and where it ended up; -1 is none or
+// unknown. pinned is false if the kernel refused the requested CPU.
+struct Placement {
+    int requested = -1;
+    int cpu = -1;
+    int node = -1;
+    bool pinned = false;
+};
+
+// Binds the calling thread to cpu (-1 leaves it free) and reports where it
+// runs now. Memory the thread touches first afterwards is then allocated on
+// that CPU's NUMA node under the default local-allocation policy.
+Placement pin_current_thread(int cpu);
+
+std::string placement_text(const Placement& p);
+
+// Restores the calling thread's CPU affinity on scope exit, for threads that
+// are pinned only for the duration of a run.
+struct AffinityScope {
+    cpu_set_t saved;
+    bool valid = false;
+
+    AffinityScope();
+    ~AffinityScope();
+    AffinityScope(const AffinityScope&) = delete;
+    AffinityScope& operator=(const AffinityScope&) = delete;
+};
+
+} // namespace dpi
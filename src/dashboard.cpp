@@ -0,0 +1,178 @@
+// dashboard.cpp - live view of a run on the terminal
+
+#include "dashboard.h"
+
+#include <signal.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdio>
+#include <format>
+#include <iterator>
+
+using namespace std::chrono;
+
+namespace dpi {
+
+static const size_t DEFAULT_COLUMNS = 100;
+static const size_t BAR_COLUMNS = 40;
+
+static size_t terminal_columns() {
+    winsize ws{};
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) return ws.ws_col;
+    return DEFAULT_COLUMNS;
+}
+
+// Ctrl-C is how a --daemon run is stopped. The cursor is hidden while a
+// dashboard runs, so it is shown again before the signal ends the process.
+static struct sigaction saved_int, saved_term;
+
+static void show_cursor_and_reraise(int sig) {
+    static const char show[] = "\033[?25h\n";
+    [[maybe_unused]] ssize_t w = ::write(STDOUT_FILENO, show, sizeof(show) - 1);
+    sigaction(sig, sig == SIGINT ? &saved_int : &saved_term, nullptr);
+    raise(sig);
+}
+
+// Result rows and messages are kept for the next frame; progress lines are
+// switched off while the dashboard runs. Called by the logger thread, or by whoever
+// logs while the logger is stopped.
+static void dashboard_sink(LogKind kind, const char* text, void* user) {
+    Dashboard* d = static_cast<Dashboard*>(user);
+    std::lock_guard<std::mutex> lk(d->mtx);
+    switch (kind) {
+    case LogKind::Line:
+        d->rows[d->row_count++ % Dashboard::RECENT_ROWS] = text;
+        break;
+    case LogKind::Inline:
+        break;
+    case LogKind::Message:
+        d->messages.emplace_back(text);
+        break;
+    }
+}
+
+void Dashboard::start() {
+    if (running) return;
+    running = true;
+    stopping = false;
+    started = steady_clock::now();
+    row_count = 0;
+    messages.clear();
+    drawn = 0;
+    ctx.progress.enabled = true;
+    {
+        std::lock_guard<std::mutex> lk(ctx.log.mtx);
+        saved_sink = ctx.log.sink;
+        saved_flush = ctx.log.flush;
+        saved_user = ctx.log.user;
+        saved_progress = ctx.log.progress;
+        ctx.log.sink = dashboard_sink;
+        ctx.log.flush = nullptr;
+        ctx.log.user = this;
+        ctx.log.progress = false;
+    }
+    struct sigaction sa{};
+    sa.sa_handler = show_cursor_and_reraise;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGINT, &sa, &saved_int);
+    sigaction(SIGTERM, &sa, &saved_term);
+    std::fputs("\033[?25l", stdout);
+    thread = std::thread([this] {
+        std::unique_lock<std::mutex> lk(mtx);
+        while (!stopping) {
+            draw();
+            cv.wait_for(lk, milliseconds(FRAME_MS), [this] { return stopping; });
+        }
+    });
+}
+
+void Dashboard::stop() {
+    if (!running) return;
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+    {
+        std::lock_guard<std::mutex> lk(ctx.log.mtx);
+        ctx.log.sink = saved_sink;
+        ctx.log.flush = saved_flush;
+        ctx.log.user = saved_user;
+        ctx.log.progress = saved_progress;
+    }
+    ctx.progress.enabled = false;
+    running = false;
+
+    std::lock_guard<std::mutex> lk(mtx);
+    draw(true);
+    std::fputs("\033[?25h", stdout);
+    sigaction(SIGINT, &saved_int, nullptr);
+    sigaction(SIGTERM, &saved_term, nullptr);
+    for (const auto& m : messages) {
+        std::fputs(m.c_str(), stdout);
+        std::fputc('\n', stdout);
+    }
+    std::fflush(stdout);
+}
+
+// Redraws the whole frame in place: back to the first line of the previous
+// frame, then every line cleared to its end. The last frame leaves out the
+// messages, which stop() prints in full below it. Called with mtx held.
+void Dashboard::draw(bool last) {
+    const Progress& p = ctx.progress;
+    const size_t columns = terminal_columns();
+    const size_t total = p.total.load(std::memory_order_acquire);
+    const auto phase = [&](Phase ph) { return p.in_phase[static_cast<size_t>(ph)].load(std::memory_order_relaxed); };
+    const auto verdict = [&](Verdict v) { return p.verdicts[static_cast<size_t>(v)].load(std::memory_order_relaxed); };
+    const size_t done = std::min(phase(Phase::Done), total);
+    const double seconds = duration_cast<duration<double>>(steady_clock::now() - started).count();
+
+    frame.clear();
+    if (drawn > 0) std::format_to(std::back_inserter(frame), "\033[{}F", drawn);
+    size_t lines = 0;
+    const auto line = [&](std::string_view text) {
+        append_fitted(frame, text, columns);
+        frame += "\033[K\n";
+        ++lines;
+    };
+
+    const size_t filled = total > 0 ? done * BAR_COLUMNS / total : 0;
+    std::string text = std::format("{:7.1f} s  [{}{}] {}/{} probes, {:.1f}/s", seconds, std::string(filled, '#'),
+                                   std::string(BAR_COLUMNS - filled, '.'), done, total,
+                                   seconds > 0 ? done / seconds : 0.0);
+    line(text);
+    text.clear();
+    for (size_t i = 0; i < static_cast<size_t>(Phase::Count); ++i) {
+        std::format_to(std::back_inserter(text), "{}{} {}", i ? " | " : "", PHASE_TEXT[i], phase(static_cast<Phase>(i)));
+    }
+    line(text);
+    text = std::format("not detected {} | possibly {} | detected {} | failed {} | {:.1f} MiB moved",
+                       verdict(Verdict::NotDetected), verdict(Verdict::PossiblyDetected),
+                       verdict(Verdict::DetectedBlocked) + verdict(Verdict::Detected), verdict(Verdict::Failed),
+                       p.bytes.load(std::memory_order_relaxed) / (1024.0 * 1024.0));
+    line(text);
+
+    // Oldest first, padded with blank lines so the frame keeps its height.
+    line("");
+    const size_t shown_rows = std::min(row_count, RECENT_ROWS);
+    for (size_t i = 0; i < RECENT_ROWS; ++i) {
+        line(i < shown_rows ? std::string_view(rows[(row_count - shown_rows + i) % RECENT_ROWS]) : "");
+    }
+    if (last) {
+        frame += "\033[J";
+    } else {
+        line("");
+        const size_t shown_messages = std::min(messages.size(), RECENT_MESSAGES);
+        for (size_t i = 0; i < RECENT_MESSAGES; ++i) {
+            line(i < shown_messages ? std::string_view(messages[messages.size() - shown_messages + i]) : "");
+        }
+    }
+
+    drawn = lines;
+    std::fwrite(frame.data(), 1, frame.size(), stdout);
+    std::fflush(stdout);
+}
+
+} // namespace dpi
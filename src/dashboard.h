@@ -0,0 +1,54 @@
+// dashboard.h - live view of a run on the terminal
+#pragma once
+
+#include "context.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace dpi {
+
+// Between start() and stop() the context's log lines go here instead of
+// stdout, and a thread redraws a fixed-height frame FRAME_MS apart from
+// ctx.progress: counts per phase and verdict, bytes, rate, the latest result
+// rows and messages. A frame costs the same for ten probes as for a million.
+// Meant for a terminal; stop() leaves the last frame on screen and prints the
+// messages of the run below it.
+struct Dashboard {
+    static constexpr int FRAME_MS = 100;
+    static constexpr size_t RECENT_ROWS = 8;
+    static constexpr size_t RECENT_MESSAGES = 4;
+
+    Context& ctx;
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::thread thread;
+    bool running = false;
+    bool stopping = false;
+    LogSink saved_sink = nullptr;       // the log's own output, back after stop()
+    LogFlush saved_flush = nullptr;
+    void* saved_user = nullptr;
+    bool saved_progress = true;
+
+    std::chrono::steady_clock::time_point started;
+    std::string rows[RECENT_ROWS];      // ring of the latest result rows
+    size_t row_count = 0;
+    std::vector<std::string> messages;
+    size_t drawn = 0;                   // lines of the frame on screen
+    std::string frame;
+
+    explicit Dashboard(Context& ctx) : ctx(ctx) {}
+    Dashboard(const Dashboard&) = delete;
+    Dashboard& operator=(const Dashboard&) = delete;
+    ~Dashboard() { stop(); }
+
+    void start();
+    void stop();
+    void draw(bool last = false);
+};
+
+} // namespace dpi
@@ -0,0 +1,801 @@
+// engine.cpp - probe setup, curl callbacks, verdicts and the probe coroutines
+
+#include "engine.h"
+#include "cpu.h"
+#include "loop.h"
+#include "suite.h"
+
+#include <linux/sockios.h>
+#include <sys/ioctl.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <format>
+#include <functional>
+#include <latch>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std::chrono;
+
+namespace dpi {
+
+// Per-address verdict counts for --dual-stack / --per-ip runs.
+static void log_target_summary(Context& ctx) {
+    const ResultStore& store = ctx.store;
+    for (size_t slot = 0; slot < store.count;) {
+        const Test& t = ctx.tests[store.test[slot]];
+        const uint16_t target = store.target[slot];
+        size_t n = 0, detected = 0;
+        for (; slot < store.count && store.test[slot] == store.test[slot - n] && store.target[slot] == target; ++slot, ++n) {
+            if (is_detected(store.verdict[slot])) detected++;
+        }
+        if (target == NO_TARGET) continue;
+        log_msg(ctx.log, ctx.strings.str(t.id), std::format("{} IPv{}: detected {}/{}",
+                                                            ip_text(t.targets[target].addr), t.targets[target].addr.family,
+                                                            detected, n));
+    }
+}
+
+static const size_t CACHE_BUSTER_HEX = 16;
+
+// Writes "<base>[?&]t=<16 hex digits>" into buf, reusing its capacity.
+static void build_probe_url(std::string& buf, const std::string& base, uint64_t token) {
+    static const char HEX[] = "0123456789abcdef";
+    const size_t n = base.size();
+    buf.resize(n + 3 + CACHE_BUSTER_HEX);
+    char* out = buf.data();
+    base.copy(out, n);
+    out[n] = (base.find('?') == std::string::npos) ? '?' : '&';
+    out[n + 1] = 't';
+    out[n + 2] = '=';
+    for (size_t i = 0; i < CACHE_BUSTER_HEX; ++i) {
+        out[n + 3 + i] = HEX[(token >> ((CACHE_BUSTER_HEX - 1 - i) * 4)) & 0xf];
+    }
+}
+
+// Upload probes stream UPLOAD_BYTES out of the context's one buffer, so
+// payload memory does not grow with concurrency.
+static void init_upload_payload(Context& ctx) {
+    SplitMix64 rng{ctx.cfg.seed};
+    for (size_t i = 0; i < UPLOAD_CHUNK_BYTES; i += sizeof(uint64_t)) {
+        uint64_t v = rng.next();
+        std::memcpy(ctx.upload_payload + i, &v, sizeof(v));
+    }
+}
+
+static void init_headers(Context& ctx) {
+    curl_slist_free_all(ctx.cache_buster_headers);
+    curl_slist_free_all(ctx.upload_headers);
+    ctx.cache_buster_headers = nullptr;
+    ctx.upload_headers = nullptr;
+    if (ctx.cfg.cache_buster == CacheBuster::Header) {
+        ctx.cache_buster_headers = curl_slist_append(ctx.cache_buster_headers, "Cache-Control: no-cache");
+        ctx.cache_buster_headers = curl_slist_append(ctx.cache_buster_headers, "Pragma: no-cache");
+        ctx.upload_headers = curl_slist_append(ctx.upload_headers, "Cache-Control: no-cache");
+        ctx.upload_headers = curl_slist_append(ctx.upload_headers, "Pragma: no-cache");
+    }
+    ctx.upload_headers = curl_slist_append(ctx.upload_headers, "Expect:");
+}
+
+// Upload bytes the peer has acknowledged: what curl wrote minus what is still
+// sitting unacknowledged in the socket send queue. Upload probes always have
+// a connection of their own (see grouped()), so before it exists nothing is
+// acked.
+static size_t acked_upload_bytes(curl_socket_t sock, curl_off_t ulnow) {
+    int outq = 0;
+    if (sock == CURL_SOCKET_BAD) return 0;
+    if (ioctl(sock, SIOCOUTQ, &outq) != 0) return static_cast<size_t>(ulnow);
+    return ulnow > outq ? static_cast<size_t>(ulnow - outq) : 0;
+}
+
+// CURLINFO_ACTIVESOCKET is not valid mid-transfer, so remember the socket here.
+static int sockopt_cb(void* clientp, curl_socket_t sock, curlsocktype purpose) {
+    if (purpose == CURLSOCKTYPE_IPCXN) static_cast<ProbeState*>(clientp)->sock = sock;
+    return CURL_SOCKOPT_OK;
+}
+
+static size_t read_cb(char* buffer, size_t size, size_t nitems, void* userdata) {
+    ProbeState* st = static_cast<ProbeState*>(userdata);
+    size_t n = std::min(size * nitems, UPLOAD_BYTES - st->upload_queued);
+    for (size_t done = 0; done < n;) {
+        size_t off = (st->upload_queued + done) % UPLOAD_CHUNK_BYTES;
+        size_t chunk = std::min(n - done, UPLOAD_CHUNK_BYTES - off);
+        std::memcpy(buffer + done, st->payload + off, chunk);
+        done += chunk;
+    }
+    st->upload_queued += n;
+    return n;
+}
+
+static void classify(ResultStore& store, size_t i, CURLcode rc, const ProbeState& st) {
+    const size_t moved = st.upload ? st.upload_acked : st.received;
+    Verdict v;
+    Detail d;
+    switch (rc) {
+    case CURLE_OK:
+        if (moved >= OK_THRESHOLD_BYTES) {
+            v = Verdict::NotDetected;       d = Detail::ThresholdReceived;
+        } else {
+            v = Verdict::PossiblyDetected;  d = Detail::StreamTooSmall;
+        }
+        break;
+
+    case CURLE_OPERATION_TIMEDOUT:
+        if (moved == 0) {
+            v = Verdict::DetectedBlocked;   d = Detail::TimeoutZeroBytes;
+        } else {
+            v = Verdict::Detected;          d = st.upload ? Detail::UploadStalled : Detail::TimeoutPartial;
+        }
+        break;
+
+    case CURLE_ABORTED_BY_CALLBACK:
+        if (st.aborted_by_threshold) {
+            v = Verdict::NotDetected;       d = Detail::EarlyAbort;
+        } else {
+            v = Verdict::Detected;          d = Detail::UnexpectedAbort;
+        }
+        break;
+
+    default:
+        v = Verdict::Failed;                d = Detail::CurlError;
+        break;
+    }
+    store.verdict[i] = v;
+    store.detail[i] = d;
+    store.curl_code[i] = rc;
+    store.received[i] = st.received;
+    store.uploaded[i] = st.upload_acked;
+}
+
+static void progress_done(Context& ctx, size_t slot) {
+    if (!ctx.progress.enabled) return;
+    const ResultStore& store = ctx.store;
+    ctx.progress.finish(slot, store.verdict[slot],
+                        store.kind[slot] == ProbeKind::Upload ? store.uploaded[slot] : store.received[slot]);
+}
+
+// Logs a finished slot and hands it to the context's result callback.
+static void report_result(Context& ctx, size_t slot, std::string_view id) {
+    progress_done(ctx, slot);
+    log_result(ctx.log, ctx.store, slot, id);
+    if (ctx.on_result) {
+        std::lock_guard<std::mutex> lk(ctx.result_mtx);
+        ctx.on_result(ctx, slot);
+    }
+}
+
+// A slot that was never started because its multi handle could not be set up.
+static void fail_init(Context& ctx, size_t slot) {
+    ResultStore& store = ctx.store;
+    store.verdict[slot] = Verdict::Failed;
+    store.detail[slot] = Detail::InitFailed;
+    report_result(ctx, slot, result_id(ctx.strings, ctx.tests[store.test[slot]], store, slot));
+}
+
+// Whether a test's repetitions run as one unit on a shared connection
+// (--h2-multiplex). Tests pinned to HTTP/1.1 are left out: grouping them
+// would have to override their protocol, so they keep a connection each.
+// Uploads are left out too: their acked bytes come from the socket's send
+// queue, which only means something for a connection of their own.
+static bool grouped(const Config& cfg, const Test& t) {
+    return cfg.h2_multiplex && t.protocol != Protocol::H1 && t.kind != ProbeKind::Upload;
+}
+
+// The same for a whole work unit: one slot, or a repetition group, see
+// grouped().
+static void fail_unit(Context& ctx, size_t first_slot) {
+    const Test& t = ctx.tests[ctx.store.test[first_slot]];
+    const size_t count = grouped(ctx.cfg, t) ? t.times : 1;
+    for (size_t slot = first_slot; slot < first_slot + count; ++slot) fail_init(ctx, slot);
+}
+
+static const size_t POOL_MAX = 4096;    // handles a reactor keeps once a run ends
+
+// One thread's share of a run: its own event loop (epoll, timerfd) and curl
+// multi, plus a queue of units it has not started yet. The owner takes from
+// the front; a reactor that runs dry steals the back half of another's.
+// Reactors live in the context and outlast the run, so their queue, frame
+// pool and easy handles keep their memory from one run (daemon round,
+// dpi_submit) to the next. Cache-line aligned so one reactor's lock and
+// counters never share a line with its neighbour's.
+struct alignas(64) Reactor {
+    EventLoop loop;
+    FramePool frames;
+    std::vector<CURL*> handles;   // configured and free, see acquire_handle
+    std::mutex mtx;
+    std::vector<size_t> pending;  // first slot of each unit; pending[head..] is left
+    size_t head = 0;
+    std::vector<size_t> loot;     // steal() scratch
+    size_t started = 0;
+    size_t stolen = 0;
+    int cpu = -1;
+    Placement placement;
+
+    ~Reactor() {
+        for (CURL* h : handles) curl_easy_cleanup(h);
+    }
+};
+
+// Settings every probe shares, applied once when a handle is created.
+static CURL* new_handle();
+
+// A finished probe's handle goes back to its reactor with those settings
+// intact, so the next probe only sets what differs; see start_probe.
+static CURL* acquire_handle(Reactor& r) {
+    if (r.handles.empty()) return new_handle();
+    CURL* h = r.handles.back();
+    r.handles.pop_back();
+    return h;
+}
+
+static void release_handle(Reactor& r, CURL* h) { r.handles.push_back(h); }
+
+// One in-flight probe: the result slot it reports into plus its live state.
+// It lives in the probe's coroutine frame, so &st stays put while curl holds it.
+// Its deadline and stall timers sit on the reactor's wheel and end the
+// transfer through xfer, which is set while it is on the multi.
+struct Probe {
+    Context* ctx = nullptr;
+    Reactor* reactor = nullptr;
+    const Test* test = nullptr;
+    size_t slot = 0;
+    int track = 0;
+    ProbeState st;
+    CURL* curl = nullptr;
+    steady_clock::time_point t_start;
+    long long trace_start_us = 0;
+    long long perform_start_us = 0;
+    Multi::Transfer* xfer = nullptr;
+    TimerNode deadline;
+    TimerNode stall;
+};
+
+static size_t write_cb(char* ptr, size_t size, size_t nmemb, void* userdata) {
+    size_t real = size * nmemb;
+    Probe* p = static_cast<Probe*>(userdata);
+    ProbeState& st = p->st;
+    if (st.received == 0 && p->ctx->progress.enabled) p->ctx->progress.set(p->slot, Phase::Transferring);
+    st.received += real;
+    if (!st.upload) {
+        st.last_progress = steady_clock::now();
+        if (st.received >= OK_THRESHOLD_BYTES && !st.aborted_by_threshold) {
+            st.aborted_by_threshold = true;
+            p->xfer->finish(CURLE_ABORTED_BY_CALLBACK);
+        }
+    }
+    return real;
+}
+
+// Upload probes only: acknowledged bytes are not visible in any data
+// callback, so they are polled here. Downloads count in write_cb.
+static int xferinfo_cb(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t ulnow) {
+    Probe* p = static_cast<Probe*>(userdata);
+    ProbeState* st = &p->st;
+    size_t acked = acked_upload_bytes(st->sock, ulnow);
+    if (acked > st->upload_acked) {
+        if (st->upload_acked == 0 && p->ctx->progress.enabled) p->ctx->progress.set(p->slot, Phase::Transferring);
+        st->upload_acked = acked;
+        st->last_progress = steady_clock::now();
+    }
+    if (st->upload_acked >= OK_THRESHOLD_BYTES) {
+        st->aborted_by_threshold = true;
+        return 1;
+    }
+    return 0;
+}
+
+static CURL* new_handle() {
+    CURL* curl = curl_easy_init();
+    if (!curl) return nullptr;
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 0L);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_cb);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_ACCEPT_ENCODING, "gzip, br");
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/142.0.0.0 Safari/537.36");
+    curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_cb);
+    curl_easy_setopt(curl, CURLOPT_XFERINFOFUNCTION, xferinfo_cb);
+    curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, static_cast<curl_off_t>(UPLOAD_BYTES));
+    return curl;
+}
+
+void free_handles(Context& ctx) { ctx.reactors.clear(); }
+
+// The probe's display id, built in a per-thread buffer that the next call
+// overwrites.
+static const std::string& probe_id(const Probe& p) {
+    thread_local std::string id;
+    id.clear();
+    append_result_id(id, p.ctx->strings, *p.test, p.ctx->store, p.slot);
+    return id;
+}
+
+// Total timeout: the probe is cut off like CURLOPT_TIMEOUT_MS would.
+static void deadline_fire(TimerNode&, void* arg) {
+    static_cast<Probe*>(arg)->xfer->finish(CURLE_OPERATION_TIMEDOUT);
+}
+
+// Idle timeout (--stall-ms). Progress does not touch the wheel; when the
+// timer comes due it is pushed out to last_progress + window if data moved
+// in the meantime, so a busy transfer costs one re-arm per window.
+static void stall_fire(TimerNode& n, void* arg) {
+    Probe& p = *static_cast<Probe*>(arg);
+    const steady_clock::time_point idle_until = p.st.last_progress + milliseconds(p.ctx->cfg.stall_ms);
+    if (idle_until > steady_clock::now()) {
+        p.xfer->multi.loop.wheel.schedule(n, idle_until);
+        return;
+    }
+    p.xfer->finish(CURLE_OPERATION_TIMEDOUT);
+}
+
+static const char* http_version_text(long v) {
+    switch (v) {
+    case CURL_HTTP_VERSION_1_0: return "HTTP/1.0";
+    case CURL_HTTP_VERSION_1_1: return "HTTP/1.1";
+    case CURL_HTTP_VERSION_2_0: return "HTTP/2";
+    case CURL_HTTP_VERSION_3:   return "HTTP/3";
+    default:                    return "HTTP/?";
+    }
+}
+
+// Takes a pooled easy handle and sets what differs between probes; anything
+// one kind of probe sets is set back by the other, so a handle carries
+// nothing over. On failure the slot is marked failed and false is returned.
+static bool start_probe(Probe& p, Context& ctx, Reactor& r, const Test& t, size_t slot) {
+    ResultStore& store = ctx.store;
+    Tracer& tr = ctx.trace;
+    const Config& cfg = ctx.cfg;
+    p.st = ProbeState{};
+    p.ctx = &ctx;
+    p.reactor = &r;
+    p.test = &t;
+    p.slot = slot;
+    p.track = static_cast<int>(slot) + 1;
+    const std::string& id = probe_id(p);
+    if (ctx.progress.enabled) ctx.progress.set(slot, Phase::Connecting);
+
+    p.t_start = steady_clock::now();
+    p.trace_start_us = tr.enabled ? tr.now_us() : 0;
+    if (tr.enabled) tr.track(p.track, id);
+
+    p.curl = acquire_handle(r);
+    if (!p.curl) {
+        store.verdict[slot] = Verdict::Failed;
+        store.detail[slot] = Detail::InitFailed;
+        report_result(ctx, slot, id);   // its row reads "curl_easy_init failed"
+        return false;
+    }
+    CURL* curl = p.curl;
+
+    // curl copies the URL, so one buffer per thread serves every probe.
+    thread_local std::string url;
+    if (cfg.cache_buster == CacheBuster::Query) {
+        SplitMix64 rng{cfg.seed + slot * 0x9e3779b97f4a7c15ULL};
+        build_probe_url(url, t.url, rng.next());
+    } else {
+        url = t.url;
+    }
+
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &p);
+
+    p.st.last_progress = p.t_start;
+    if (t.kind == ProbeKind::Upload) {
+        p.st.upload = true;
+        p.st.payload = ctx.upload_payload;
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 0L);
+        curl_easy_setopt(curl, CURLOPT_XFERINFODATA, &p);
+        curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, sockopt_cb);
+        curl_easy_setopt(curl, CURLOPT_SOCKOPTDATA, &p.st);
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &p.st);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, ctx.upload_headers);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+        curl_easy_setopt(curl, CURLOPT_SOCKOPTFUNCTION, nullptr);
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER,
+                         cfg.cache_buster == CacheBuster::Header ? ctx.cache_buster_headers : nullptr);
+    }
+
+    curl_slist* resolve = store.target[slot] != NO_TARGET ? t.targets[store.target[slot]].resolve : t.resolve;
+    curl_easy_setopt(curl, CURLOPT_RESOLVE, resolve);
+
+    long version = CURL_HTTP_VERSION_NONE;
+    switch (t.protocol) {
+    case Protocol::H1: version = CURL_HTTP_VERSION_1_1; break;
+    case Protocol::H2: version = CURL_HTTP_VERSION_2TLS; break;
+    case Protocol::H3: version = CURL_HTTP_VERSION_3ONLY; break;
+    default: break;
+    }
+    curl_easy_setopt(curl, CURLOPT_HTTP_VERSION, version);
+
+    if (ctx.log.progress) {
+        TraceScope span(tr, p.track, "log", "log_start");
+        log_start(ctx.log, id, url);
+    }
+    p.perform_start_us = tr.enabled ? tr.now_us() : 0;
+    return true;
+}
+
+// Collects timings and transfer info, releases the handle and reports the verdict.
+static void finish_probe(Probe& p, CURLcode rc) {
+    Context& ctx = *p.ctx;
+    ResultStore& store = ctx.store;
+    Tracer& tr = ctx.trace;
+    const size_t slot = p.slot;
+
+    auto t_end = steady_clock::now();
+    store.elapsed_ms[slot] = duration_cast<duration<double, std::milli>>(t_end - p.t_start).count();
+    store.stall_ms[slot] = duration_cast<duration<double, std::milli>>(t_end - p.st.last_progress).count();
+
+    long port = 0, version = 0;
+    curl_easy_getinfo(p.curl, CURLINFO_RESPONSE_CODE, &store.http_code[slot]);
+    curl_easy_getinfo(p.curl, CURLINFO_LOCAL_PORT, &port);
+    curl_easy_getinfo(p.curl, CURLINFO_HTTP_VERSION, &version);
+    char* primary_ip = nullptr;
+    curl_easy_getinfo(p.curl, CURLINFO_PRIMARY_IP, &primary_ip);
+    store.ip[slot] = parse_ip(primary_ip);
+    // A pinned probe that never connected still went to its target; record
+    // that, so results files key it the same way every round.
+    if (store.ip[slot].family == 0 && store.target[slot] != NO_TARGET) {
+        store.ip[slot] = p.test->targets[store.target[slot]].addr;
+    }
+    store.local_port[slot] = static_cast<uint16_t>(port);
+    store.http_version[slot] = static_cast<uint8_t>(version);
+    trace_transfer(tr, p.curl, p.track, p.perform_start_us);
+    release_handle(*p.reactor, p.curl);
+    p.curl = nullptr;
+
+    classify(store, slot, rc, p.st);
+
+    const std::string& id = probe_id(p);
+    {
+        TraceScope span(tr, p.track, "log", "log_result");
+        report_result(ctx, slot, id);
+    }
+
+    if (tr.enabled) {
+        tr.span(p.track, "probe", id, p.trace_start_us, tr.now_us() - p.trace_start_us,
+                std::format("{{\"http_code\":{},\"bytes\":{},\"result\":\"{}\"}}",
+                            store.http_code[slot], store.received[slot], json_escape(detail_text(store, slot))));
+    }
+}
+
+static const long RETRY_BACKOFF_MS = 250;   // doubled per attempt
+
+// Failures before any HTTP exchange that another attempt may get past. Resets
+// and timeouts mid-transfer are what the probes look for and are never retried.
+static bool retryable(CURLcode rc) {
+    return rc == CURLE_COULDNT_RESOLVE_HOST || rc == CURLE_COULDNT_CONNECT;
+}
+
+// One slot from start to verdict: connect and measure, retrying connection
+// failures up to cfg.retries times. Probes on the shared multi get their own
+// connection each; grouped probes (--h2-multiplex) share one.
+static Task run_probe(Context& ctx, Multi& multi, Reactor& r, const Test& t, size_t slot, bool grouped) {
+    ResultStore& store = ctx.store;
+    if (t.protocol == Protocol::H3 && !(curl_version_info(CURLVERSION_NOW)->features & CURL_VERSION_HTTP3)) {
+        store.verdict[slot] = Verdict::Failed;
+        store.detail[slot] = Detail::Unsupported;
+        report_result(ctx, slot, result_id(ctx.strings, t, store, slot));
+        co_return;
+    }
+
+    Probe p;
+    p.deadline.fire = deadline_fire;
+    p.deadline.arg = &p;
+    p.stall.fire = stall_fire;
+    p.stall.arg = &p;
+    for (int attempt = 0;; ++attempt) {
+        if (!start_probe(p, ctx, r, t, slot)) co_return;
+        curl_easy_setopt(p.curl, CURLOPT_FRESH_CONNECT, grouped ? 0L : 1L);
+        curl_easy_setopt(p.curl, CURLOPT_FORBID_REUSE, grouped ? 0L : 1L);
+        curl_easy_setopt(p.curl, CURLOPT_PIPEWAIT, grouped ? 1L : 0L);
+        if (grouped && t.protocol == Protocol::Default) curl_easy_setopt(p.curl, CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+
+        // Timeouts are wheel entries rather than curl options; see
+        // deadline_fire and stall_fire.
+        Multi::Transfer xfer = multi.transfer(p.curl);
+        p.xfer = &xfer;
+        TimerWheel& wheel = multi.loop.wheel;
+        wheel.schedule(p.deadline, p.t_start + milliseconds(ctx.cfg.timeout_ms));
+        if (ctx.cfg.stall_ms > 0 && ctx.cfg.stall_ms < ctx.cfg.timeout_ms) {
+            wheel.schedule(p.stall, p.t_start + milliseconds(ctx.cfg.stall_ms));
+        }
+        const CURLcode rc = co_await xfer;
+        p.deadline.cancel();
+        p.stall.cancel();
+        p.xfer = nullptr;
+        if (attempt < ctx.cfg.retries && retryable(rc)) {
+            const long backoff = RETRY_BACKOFF_MS << attempt;
+            log_msg(ctx.log, probe_id(p), std::format("{}, retry {}/{} in {} ms", curl_easy_strerror(rc),
+                                                      attempt + 1, ctx.cfg.retries, backoff));
+            release_handle(r, p.curl);
+            p.curl = nullptr;
+            co_await multi.loop.sleep(milliseconds(backoff));
+            continue;
+        }
+        finish_probe(p, rc);
+        co_return;
+    }
+}
+
+// Runs all repetitions of one test on their own multi handle, every
+// repetition a stream on one shared connection (--h2-multiplex). Each slot
+// still gets its own byte count; the per-connection totals logged afterwards
+// show whether the DPI budget is per connection (streams freeze once their
+// sum hits the limit) or per stream.
+static Task run_multiplexed(Context& ctx, EventLoop& loop, Reactor& r, const Test& t, size_t first_slot) {
+    ResultStore& store = ctx.store;
+    const std::string& test_id = ctx.strings.str(t.id);
+    {
+        Multi multi(loop);
+        if (!multi.multi) {
+            log_msg(ctx.log, test_id, "curl_multi_init failed");
+            for (size_t slot = first_slot; slot < first_slot + t.times; ++slot) fail_init(ctx, slot);
+            co_return;
+        }
+        curl_multi_setopt(multi.multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+        curl_multi_setopt(multi.multi, CURLMOPT_MAX_HOST_CONNECTIONS, 1L);
+
+        std::vector<Task> probes;
+        for (int i = 0; i < t.times; ++i) probes.push_back(run_probe(ctx, multi, r, t, first_slot + i, true));
+        co_await when_all(loop, std::move(probes));
+    }
+
+    struct ConnStats { int streams = 0; size_t bytes = 0; uint8_t version = 0; };
+    std::vector<std::pair<uint16_t, ConnStats>> conns;
+    for (size_t slot = first_slot; slot < first_slot + t.times; ++slot) {
+        auto it = std::find_if(conns.begin(), conns.end(),
+                               [&](const auto& c) { return c.first == store.local_port[slot]; });
+        if (it == conns.end()) it = conns.insert(conns.end(), {store.local_port[slot], {}});
+        it->second.streams++;
+        it->second.bytes += store.received[slot];
+        it->second.version = store.http_version[slot];
+    }
+    for (const auto& [port, c] : conns) {
+        if (port == 0) {
+            log_msg(ctx.log, test_id, std::format("no connection: streams={}", c.streams));
+            continue;
+        }
+        log_msg(ctx.log, test_id, std::format("connection :{} {} streams={} bytes={}",
+                                              port, http_version_text(c.version), c.streams, c.bytes));
+    }
+}
+
+// Units started per loop iteration. Starting is the expensive part of a
+// probe (easy handle setup, connect), so it is interleaved with serving the
+// sockets already open, and whatever is still queued stays stealable.
+static const size_t START_BATCH = 64;
+
+// Moves the back half of the first non-empty other queue into self's.
+// Never holds two reactor locks at once.
+static bool steal(std::vector<std::unique_ptr<Reactor>>& reactors, size_t self) {
+    Reactor& r = *reactors[self];
+    r.loot.clear();
+    for (size_t k = 1; k < reactors.size() && r.loot.empty(); ++k) {
+        Reactor& victim = *reactors[(self + k) % reactors.size()];
+        std::lock_guard<std::mutex> lk(victim.mtx);
+        const size_t take = (victim.pending.size() - victim.head + 1) / 2;
+        r.loot.assign(victim.pending.end() - take, victim.pending.end());
+        victim.pending.resize(victim.pending.size() - take);
+    }
+    if (r.loot.empty()) return false;
+    std::lock_guard<std::mutex> lk(r.mtx);
+    r.pending.insert(r.pending.end(), r.loot.begin(), r.loot.end());
+    r.stolen += r.loot.size();
+    return true;
+}
+
+static void run_reactor(Context& ctx, size_t self, const std::vector<size_t>& units, std::latch& filled) {
+    std::vector<std::unique_ptr<Reactor>>& reactors = ctx.reactors;
+    const size_t n = reactors.size();
+    const std::vector<int>& cpus = ctx.cfg.reactor_cpus;
+    const int cpu = cpus.empty() ? -1 : cpus[self % cpus.size()];
+    const Placement placement = pin_current_thread(cpu);
+    // Created here, after pinning, so that the loop, its timer wheel, the
+    // pools and the queue are first touched, and thus allocated, on this
+    // reactor's NUMA node. A reactor kept from the last run stays unless its
+    // CPU changed.
+    if (!reactors[self] || reactors[self]->cpu != cpu) reactors[self] = std::make_unique<Reactor>();
+    Reactor& r = *reactors[self];
+    r.cpu = cpu;
+    r.placement = placement;
+    r.started = 0;
+    r.stolen = 0;
+    const size_t first = self * units.size() / n, last = (self + 1) * units.size() / n;
+    const bool ready = r.loop.init();
+    const int err = errno;
+    {
+        std::lock_guard<std::mutex> lk(r.mtx);
+        if (ready) r.pending.assign(units.begin() + first, units.begin() + last);
+        else r.pending.clear();
+        r.head = 0;
+    }
+    // Nobody starts, and so nobody steals, before every queue is filled.
+    filled.arrive_and_wait();
+    if (!ready) {
+        log_msg(ctx.log, "MAIN", std::format("Cannot create event loop: {}", std::strerror(err)));
+        for (size_t i = first; i < last; ++i) fail_unit(ctx, units[i]);
+        return;
+    }
+
+    FramePool::Scope frames(r.frames);
+    Multi shared(r.loop);
+    if (!shared.multi) {
+        // Every single-slot unit still queued here fails; the other reactors
+        // can only have stolen what they now run themselves. Repetition
+        // groups bring their own multi and still run.
+        log_msg(ctx.log, "MAIN", "curl_multi_init failed");
+        {
+            std::lock_guard<std::mutex> lk(r.mtx);
+            r.loot.clear();
+            const auto kept = std::remove_if(r.pending.begin() + r.head, r.pending.end(), [&](size_t slot) {
+                if (grouped(ctx.cfg, ctx.tests[ctx.store.test[slot]])) return false;
+                r.loot.push_back(slot);
+                return true;
+            });
+            r.pending.erase(kept, r.pending.end());
+        }
+        for (size_t slot : r.loot) fail_init(ctx, slot);
+    }
+
+    size_t batch[START_BATCH];
+    r.loop.feed = [&] {
+        size_t count = 0;
+        bool more = false;
+        for (int pass = 0; pass < 2 && count == 0; ++pass) {
+            // Without a shared multi only our own groups can run.
+            if (pass == 1 && (!shared.multi || !steal(reactors, self))) break;
+            std::lock_guard<std::mutex> lk(r.mtx);
+            for (; count < START_BATCH && r.head < r.pending.size(); ++count) batch[count] = r.pending[r.head++];
+            if (r.head == r.pending.size()) {
+                r.pending.clear();
+                r.head = 0;
+            }
+            // After a steal keep polling: the next iteration steals again
+            // and the loop only blocks once every queue ran dry.
+            more = !r.pending.empty() || pass == 1;
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const size_t slot = batch[i];
+            const Test& t = ctx.tests[ctx.store.test[slot]];
+            if (grouped(ctx.cfg, t)) {
+                r.loop.spawn(run_multiplexed(ctx, r.loop, r, t, slot));
+            } else {
+                r.loop.spawn(run_probe(ctx, shared, r, t, slot, false));
+            }
+        }
+        r.started += count;
+        return more;
+    };
+    r.loop.run();
+    r.loop.feed = nullptr;
+    if (r.handles.size() > POOL_MAX) {
+        for (size_t i = POOL_MAX; i < r.handles.size(); ++i) curl_easy_cleanup(r.handles[i]);
+        r.handles.resize(POOL_MAX);
+    }
+}
+
+// Linear scan over the verdict column; cheap even for very large runs.
+void log_summary(Logger& log, const ResultStore& store) {
+    size_t counts[static_cast<size_t>(Verdict::Count)] = {};
+    for (size_t i = 0; i < store.count; ++i) {
+        counts[static_cast<size_t>(store.verdict[i])]++;
+    }
+    log_msg(log, "MAIN", std::format("Summary: {} probes | not detected {} | possibly {} | detected {} | failed {}",
+                                     store.count,
+                                     counts[static_cast<size_t>(Verdict::NotDetected)],
+                                     counts[static_cast<size_t>(Verdict::PossiblyDetected)],
+                                     counts[static_cast<size_t>(Verdict::DetectedBlocked)] + counts[static_cast<size_t>(Verdict::Detected)],
+                                     counts[static_cast<size_t>(Verdict::Failed)]));
+}
+
+void run_suite(Context& ctx) {
+    std::vector<Test>& tests = ctx.tests;
+    ResultStore& store = ctx.store;
+    const Config& cfg = ctx.cfg;
+
+    init_headers(ctx);
+    init_upload_payload(ctx);
+    free_resolved(tests);
+    if (cfg.preresolve || cfg.addr_mode != AddrMode::Default) preresolve(ctx);
+
+    // Slots are laid out test -> target -> repetition, so every (test, target)
+    // group is a contiguous run of t.times slots.
+    size_t total = 0;
+    for (const auto& t : tests) {
+        total += (t.times > 0 ? t.times : 0) * std::max<size_t>(1, t.targets.size());
+    }
+
+    store.allocate(total);
+    for (size_t ti = 0, slot = 0; ti < tests.size(); ++ti) {
+        const size_t targets = std::max<size_t>(1, tests[ti].targets.size());
+        for (size_t tg = 0; tg < targets; ++tg)
+        for (int i = 0; i < tests[ti].times; ++i, ++slot) {
+            store.test[slot] = static_cast<uint32_t>(ti);
+            store.target[slot] = tests[ti].targets.empty() ? NO_TARGET : static_cast<uint16_t>(tg);
+            store.ip[slot] = IpAddr{};
+            store.id[slot] = tests[ti].id;
+            store.provider[slot] = tests[ti].provider;
+            store.rep[slot] = static_cast<uint32_t>(i);
+            store.http_code[slot] = 0;
+            store.received[slot] = 0;
+            store.elapsed_ms[slot] = 0.0;
+            store.stall_ms[slot] = 0.0;
+            store.uploaded[slot] = 0;
+            store.kind[slot] = tests[ti].kind;
+            store.curl_code[slot] = 0;
+            store.local_port[slot] = 0;
+            store.http_version[slot] = 0;
+            store.verdict[slot] = Verdict::Failed;
+            store.detail[slot] = Detail::None;
+        }
+    }
+
+    if (ctx.progress.enabled) ctx.progress.reset(total);
+
+    // Work units are single slots, or whole repetition groups, see
+    // grouped(). Each reactor starts with a contiguous share of them.
+    std::vector<size_t> units;
+    units.reserve(total);
+    for (size_t slot = 0; slot < total;) {
+        units.push_back(slot);
+        const Test& t = tests[store.test[slot]];
+        slot += grouped(cfg, t) ? t.times : 1;
+    }
+    size_t n = cfg.reactors > 0             ? static_cast<size_t>(cfg.reactors)
+             : !cfg.reactor_cpus.empty() ? cfg.reactor_cpus.size()
+                                         : std::max(1u, std::thread::hardware_concurrency());
+    n = std::clamp<size_t>(n, 1, std::max<size_t>(1, units.size()));
+
+    // Missing reactors are created by their own threads, see run_reactor.
+    std::vector<std::unique_ptr<Reactor>>& reactors = ctx.reactors;
+    reactors.resize(n);
+
+    ctx.log.cpu = cfg.logger_cpu;
+    ctx.log.start();
+    {
+        TraceScope span(ctx.trace, 0, "main", "reactors");
+        std::latch filled(static_cast<std::ptrdiff_t>(n));
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < n; ++i) {
+            threads.emplace_back(run_reactor, std::ref(ctx), i, std::cref(units), std::ref(filled));
+        }
+        AffinityScope keep;     // the caller is reactor 0
+        run_reactor(ctx, 0, units, filled);
+        for (auto& th : threads) th.join();
+    }
+    ctx.log.stop();
+
+    if (n > 1 || !cfg.reactor_cpus.empty() || cfg.logger_cpu >= 0) {
+        for (size_t i = 0; i < n; ++i) {
+            const Reactor& r = *reactors[i];
+            const std::string where = placement_text(r.placement);
+            log_msg(ctx.log, "MAIN", std::format("Reactor {} ({}): {} units started, {} stolen",
+                                                 i, where, r.started, r.stolen));
+            ctx.trace.label(std::format("reactor {}: {}", i, where));
+        }
+        const std::string where = placement_text(ctx.log.placement);
+        log_msg(ctx.log, "MAIN", std::format("Logger ({})", where));
+        ctx.trace.label(std::format("logger: {}", where));
+    }
+
+    log_msg(ctx.log, "MAIN", "All tests finished.");
+    log_summary(ctx.log, store);
+    if (cfg.addr_mode != AddrMode::Default) log_target_summary(ctx);
+}
+
+Context::Context() = default;
+
+Context::~Context() {
+    free_resolved(tests);
+    curl_slist_free_all(cache_buster_headers);
+    curl_slist_free_all(upload_headers);
+}
+
+} // namespace dpi
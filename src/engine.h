@@ -0,0 +1,41 @@
+// engine.h - the probe engine
+#pragma once
+
+#include "context.h"
+
+#include <cstdint>
+
+namespace dpi {
+
+// splitmix64: a counter-based generator, so each probe seeds its own stream
+// at seed + slot * gamma. No shared state between probes, and the same --seed
+// always yields the same cache-busters regardless of scheduling.
+inline uint64_t splitmix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+struct SplitMix64 {
+    uint64_t state = 0;
+    uint64_t next() {
+        uint64_t r = splitmix64(state);
+        state += 0x9e3779b97f4a7c15ULL;
+        return r;
+    }
+};
+
+// Probes every test of ctx.tests once per repetition (and target), as
+// coroutines on cfg.reactors event-loop threads (the calling thread is one of
+// them), blocking until all are done. Results land in ctx.store, slots laid
+// out test -> target -> repetition.
+void run_suite(Context& ctx);
+
+void log_summary(Logger& log, const ResultStore& store);
+
+// Cleans up the context's reactors and the easy handles they pool; call
+// before curl_global_cleanup() when the context outlives it.
+void free_handles(Context& ctx);
+
+} // namespace dpi
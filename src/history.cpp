@@ -0,0 +1,173 @@
+// history.cpp - append-only binary run history
+
+#include "history.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+namespace dpi {
+
+bool MappedFile::map(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+    size = static_cast<size_t>(st.st_size);
+    if (size > 0) {
+        void* m = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (m == MAP_FAILED) {
+            ::close(fd);
+            size = 0;
+            return false;
+        }
+        data = static_cast<const char*>(m);
+        madvise(m, size, MADV_SEQUENTIAL);
+    }
+    ::close(fd);
+    return true;
+}
+
+MappedFile::~MappedFile() {
+    if (data) munmap(const_cast<char*>(data), size);
+}
+
+bool write_all(int fd, const void* buf, size_t n) {
+    const char* p = static_cast<const char*>(buf);
+    while (n > 0) {
+        ssize_t w = ::write(fd, p, n);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+    return true;
+}
+
+// Opens (creating if needed) a history file pair and checks its header.
+static int open_history_file(const std::string& path, const char (&magic)[8], uint32_t record_size, uint32_t node) {
+    int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd < 0) return -1;
+
+    struct stat st{};
+    fstat(fd, &st);
+    HistoryHeader h{};
+    if (st.st_size == 0) {
+        std::memcpy(h.magic, magic, sizeof(h.magic));
+        h.record_size = record_size;
+        h.node = node;
+        if (!write_all(fd, &h, sizeof(h))) {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+    if (pread(fd, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)) ||
+        std::memcmp(h.magic, magic, sizeof(h.magic)) != 0 || h.record_size != record_size) {
+        ::close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    return fd;
+}
+
+bool HistoryWriter::open(const std::string& path, const std::string& node) {
+    strings_fd = open_history_file(path + ".strings", HISTORY_STRINGS_MAGIC, 0, 0);
+    if (strings_fd < 0) return false;
+
+    MappedFile strings;
+    if (!strings.map(path + ".strings")) return false;
+    size_t pos = sizeof(HistoryHeader);
+    while (pos < strings.size) {
+        size_t len = strnlen(strings.data + pos, strings.size - pos);
+        offsets.emplace(std::string(strings.data + pos, len), static_cast<uint32_t>(pos));
+        pos += len + 1;
+    }
+    strings_end = strings.size;
+
+    // The strings file is opened first so a new records file can name its node.
+    uint32_t node_off = 0;
+    if (!node.empty() && (node_off = offset_of(node)) == 0) return false;
+    records_fd = open_history_file(path, HISTORY_MAGIC, sizeof(HistoryRecord), node_off);
+    return records_fd >= 0;
+}
+
+uint32_t HistoryWriter::offset_of(const std::string& str) {
+    auto it = offsets.find(str);
+    if (it != offsets.end()) return it->second;
+    uint32_t off = static_cast<uint32_t>(strings_end);
+    if (!write_all(strings_fd, str.c_str(), str.size() + 1)) {
+        // Drop whatever part made it, so the next string lands at strings_end.
+        const int err = errno;
+        [[maybe_unused]] int rc = ftruncate(strings_fd, static_cast<off_t>(strings_end));
+        errno = err;
+        return 0;
+    }
+    strings_end += str.size() + 1;
+    offsets.emplace(str, off);
+    return off;
+}
+
+uint32_t HistoryWriter::offset_of(const StringTable& strings, uint32_t handle) {
+    if (handle < handle_offsets.size() && handle_offsets[handle] != 0) return handle_offsets[handle];
+    uint32_t off = offset_of(strings.str(handle));
+    if (off == 0) return 0;
+    if (handle >= handle_offsets.size()) handle_offsets.resize(handle + 1, 0);
+    handle_offsets[handle] = off;
+    return off;
+}
+
+// Strings are written before the records that reference them, so a
+// crash can at worst leave unreferenced strings behind.
+bool HistoryWriter::append(const StringTable& strings, const ResultStore& store, int64_t ts_ms, uint32_t round) {
+    std::vector<HistoryRecord> recs(store.count);
+    for (size_t i = 0; i < store.count; ++i) {
+        HistoryRecord& r = recs[i];
+        r = HistoryRecord{};
+        r.ts_ms = ts_ms;
+        r.id = offset_of(strings, store.id[i]);
+        r.provider = offset_of(strings, store.provider[i]);
+        // A string that could not be written must not be referenced.
+        if (r.id == 0 || r.provider == 0) return false;
+        r.round = round;
+        r.rep = store.rep[i];
+        r.http_code = static_cast<int32_t>(store.http_code[i]);
+        r.curl_code = store.curl_code[i];
+        r.received = store.received[i];
+        r.uploaded = store.uploaded[i];
+        r.elapsed_ms = static_cast<float>(store.elapsed_ms[i]);
+        r.stall_ms = static_cast<float>(store.stall_ms[i]);
+        r.verdict = static_cast<uint8_t>(store.verdict[i]);
+        r.detail = static_cast<uint8_t>(store.detail[i]);
+        r.kind = static_cast<uint8_t>(store.kind[i]);
+        r.ip_family = store.ip[i].family;
+        r.pinned = store.target[i] != NO_TARGET;
+        std::memcpy(r.ip, store.ip[i].bytes, sizeof(r.ip));
+    }
+
+    // A short write is cut back off, so a failed round never leaves a
+    // partial record that would misalign every record after it.
+    struct stat st{};
+    if (fstat(records_fd, &st) != 0) return false;
+    const off_t end = st.st_size;
+    if (write_all(records_fd, recs.data(), recs.size() * sizeof(HistoryRecord))) return true;
+    const int err = errno;
+    [[maybe_unused]] int rc = ftruncate(records_fd, end);
+    errno = err;
+    return false;
+}
+
+HistoryWriter::~HistoryWriter() {
+    if (records_fd >= 0) ::close(records_fd);
+    if (strings_fd >= 0) ::close(strings_fd);
+}
+
+} // namespace dpi
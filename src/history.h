@@ -0,0 +1,75 @@
+// history.h - append-only binary run history
+#pragma once
+
+#include "types.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace dpi {
+
+// Append-only run history. <path> holds a header plus fixed-size records,
+// <path>.strings the ids/providers they reference by byte offset. Both files
+// only ever grow; queries mmap them and do a linear scan over the records.
+inline constexpr char HISTORY_MAGIC[8] = {'D', 'P', 'I', 'H', 'I', 'S', 'T', '1'};
+inline constexpr char HISTORY_STRINGS_MAGIC[8] = {'D', 'P', 'I', 'S', 'T', 'R', 'S', '1'};
+
+struct HistoryHeader {
+    char magic[8];
+    uint32_t record_size;
+    uint32_t node;      // records file: offset of the --node name in <path>.strings, 0 if none
+};
+
+struct HistoryRecord {
+    int64_t ts_ms;          // unix time of the round start
+    uint32_t id;            // offsets into <path>.strings
+    uint32_t provider;
+    uint32_t round;
+    uint32_t rep;
+    int32_t http_code;
+    int32_t curl_code;
+    uint64_t received;
+    uint64_t uploaded;
+    float elapsed_ms;
+    float stall_ms;
+    uint8_t verdict;
+    uint8_t detail;
+    uint8_t kind;
+    uint8_t ip_family;
+    uint8_t ip[16];
+    uint8_t pinned;         // probe was pinned to ip (--dual-stack / --per-ip)
+    uint8_t reserved[3];
+};
+static_assert(sizeof(HistoryRecord) == 80, "history record layout is part of the file format");
+
+struct MappedFile {
+    const char* data = nullptr;
+    size_t size = 0;
+
+    bool map(const std::string& path);
+    ~MappedFile();
+};
+
+bool write_all(int fd, const void* buf, size_t n);
+
+struct HistoryWriter {
+    int records_fd = -1;
+    int strings_fd = -1;
+    uint64_t strings_end = 0;
+    std::unordered_map<std::string, uint32_t> offsets;
+    std::vector<uint32_t> handle_offsets;   // StringTable handle -> offset cache
+
+    // node is recorded when the file is created; an existing file keeps its own.
+    bool open(const std::string& path, const std::string& node = {});
+    // Offset of str in the strings file, appending it if new; 0 (inside the
+    // header, never a string) if it could not be written.
+    uint32_t offset_of(const std::string& str);
+    uint32_t offset_of(const StringTable& strings, uint32_t handle);
+    bool append(const StringTable& strings, const ResultStore& store, int64_t ts_ms, uint32_t round);
+    ~HistoryWriter();
+};
+
+} // namespace dpi
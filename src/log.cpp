@@ -0,0 +1,350 @@
+// log.cpp - status line output
+
+#include "log.h"
+
+#include <time.h>
+#include <charconv>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace dpi {
+
+// Lines for stdout collect here until the logger's batch ends, then go out
+// in one write. Per thread, since sink and flush run on the same thread.
+static thread_local std::string stdout_pending;
+static const size_t STDOUT_CHUNK = 64 * 1024;
+
+void stdout_sink(LogKind kind, const char* text, void*) {
+    std::string& out = stdout_pending;
+    switch (kind) {
+    case LogKind::Line:
+        out += '\r';
+        out += text;
+        out += "\033[K\n";
+        break;
+    case LogKind::Inline:
+        out += '\r';
+        out += text;
+        out += "\033[K";
+        break;
+    case LogKind::Message:
+        out += text;
+        out += '\n';
+        break;
+    }
+    if (out.size() >= STDOUT_CHUNK) stdout_flush(nullptr);
+}
+
+void plain_sink(LogKind kind, const char* text, void*) {
+    if (kind == LogKind::Inline) return;
+    std::string& out = stdout_pending;
+    out += text;
+    out += '\n';
+    if (out.size() >= STDOUT_CHUNK) stdout_flush(nullptr);
+}
+
+void stdout_flush(void*) {
+    std::string& out = stdout_pending;
+    if (out.empty()) return;
+    std::fwrite(out.data(), 1, out.size(), stdout);
+    std::fflush(stdout);
+    out.clear();
+}
+
+void Logger::write(LogKind kind, const std::string& s) {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (!sink) return;
+    if (!async) {
+        sink(kind, s.c_str(), user);
+        if (flush) flush(user);
+        return;
+    }
+    const bool was_empty = queue.empty();
+    queue += static_cast<char>(kind);
+    queue += s;
+    queue += '\0';
+    if (was_empty) cv.notify_one();
+}
+
+void Logger::start() {
+    std::lock_guard<std::mutex> lk(mtx);
+    if (async) return;
+    async = true;
+    stopping = false;
+    thread = std::thread([this] {
+        const Placement p = pin_current_thread(cpu);
+        std::unique_lock<std::mutex> lk(mtx);
+        placement = p;
+        for (;;) {
+            cv.wait(lk, [this] { return !queue.empty() || stopping; });
+            if (queue.empty()) break;
+            batch.swap(queue);
+            // The sink runs unlocked; only this thread calls it while async.
+            LogSink s = sink;
+            LogFlush f = flush;
+            void* u = user;
+            lk.unlock();
+            for (const char* line = batch.data(); line < batch.data() + batch.size();) {
+                const LogKind kind = static_cast<LogKind>(*line++);
+                if (s) s(kind, line, u);
+                line += std::strlen(line) + 1;
+            }
+            if (s && f) f(u);
+            batch.clear();
+            lk.lock();
+        }
+    });
+}
+
+void Logger::stop() {
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        if (!async) return;
+        stopping = true;
+    }
+    cv.notify_one();
+    thread.join();
+    std::lock_guard<std::mutex> lk(mtx);
+    async = false;
+}
+
+// The line being formatted on this thread. Kept between calls, so
+// formatting stops allocating once it has grown to the longest line.
+static std::string& line_buffer() {
+    thread_local std::string line;
+    line.clear();
+    return line;
+}
+
+static void put_digits(char* out, unsigned v, int width) {
+    for (int i = width - 1; i >= 0; --i, v /= 10) out[i] = static_cast<char>('0' + v % 10);
+}
+
+// Log lines read CLOCK_REALTIME_COARSE: served from the vDSO without a
+// syscall and without reading the TSC, at the kernel tick's precision (1-4
+// ms), which is plenty for a log line. The "[HH:MM:SS." prefix is rebuilt
+// only when the second changes.
+struct TimestampCache {
+    time_t second = -1;
+    char prefix[10];
+};
+
+void append_timestamp(std::string& out) {
+    thread_local TimestampCache cache;
+    timespec ts{};
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if (ts.tv_sec != cache.second) {
+        const auto day = static_cast<unsigned>(ts.tv_sec % (24 * 3600));
+        char* p = cache.prefix;
+        p[0] = '[';
+        put_digits(p + 1, day / 3600, 2);
+        p[3] = ':';
+        put_digits(p + 4, day / 60 % 60, 2);
+        p[6] = ':';
+        put_digits(p + 7, day % 60, 2);
+        p[9] = '.';
+        cache.second = ts.tv_sec;
+    }
+    char text[sizeof(cache.prefix) + 4];
+    std::memcpy(text, cache.prefix, sizeof(cache.prefix));
+    put_digits(text + sizeof(cache.prefix), static_cast<unsigned>(ts.tv_nsec / 1000000), 3);
+    text[sizeof(text) - 1] = ']';
+    out.append(text, sizeof(text));
+}
+
+std::string currentTimestamp() {
+    std::string out;
+    append_timestamp(out);
+    return out;
+}
+
+// Decodes the code point at s[i] and moves i past it. Stray bytes decode as
+// themselves.
+static uint32_t next_code_point(std::string_view s, size_t& i) {
+    const unsigned char c = static_cast<unsigned char>(s[i]);
+    const size_t n = c < 0x80 ? 1 : (c >> 5) == 0x6 ? 2 : (c >> 4) == 0xe ? 3 : (c >> 3) == 0x1e ? 4 : 1;
+    if (n == 1 || i + n > s.size()) {
+        i++;
+        return c;
+    }
+    uint32_t cp = c & (0x7f >> n);
+    for (size_t k = 1; k < n; ++k) cp = (cp << 6) | (static_cast<unsigned char>(s[i + k]) & 0x3f);
+    i += n;
+    return cp;
+}
+
+// Terminal cells of a code point: 0 for combining marks, joiners and variation
+// selectors, 2 for East Asian wide characters and emoji, else 1.
+static int cells(uint32_t cp) {
+    static const uint32_t ZERO[][2] = {
+        {0x0300, 0x036f}, {0x200b, 0x200f}, {0x20d0, 0x20ff}, {0xfe00, 0xfe0f},
+    };
+    static const uint32_t WIDE[][2] = {
+        {0x1100, 0x115f}, {0x231a, 0x231b}, {0x2329, 0x232a}, {0x23e9, 0x23ec}, {0x23f0, 0x23f0},
+        {0x23f3, 0x23f3}, {0x25fd, 0x25fe}, {0x2614, 0x2615}, {0x2648, 0x2653}, {0x267f, 0x267f},
+        {0x2693, 0x2693}, {0x26a1, 0x26a1}, {0x26aa, 0x26ab}, {0x26bd, 0x26be}, {0x26c4, 0x26c5},
+        {0x26ce, 0x26ce}, {0x26d4, 0x26d4}, {0x26ea, 0x26ea}, {0x26f2, 0x26f3}, {0x26f5, 0x26f5},
+        {0x26fa, 0x26fa}, {0x26fd, 0x26fd}, {0x2705, 0x2705}, {0x270a, 0x270b}, {0x2728, 0x2728},
+        {0x274c, 0x274c}, {0x274e, 0x274e}, {0x2753, 0x2755}, {0x2757, 0x2757}, {0x2795, 0x2797},
+        {0x27b0, 0x27b0}, {0x27bf, 0x27bf}, {0x2b1b, 0x2b1c}, {0x2b50, 0x2b50}, {0x2b55, 0x2b55},
+        {0x2e80, 0x303e}, {0x3041, 0x33ff}, {0x3400, 0x4dbf}, {0x4e00, 0x9fff}, {0xa000, 0xa4cf},
+        {0xac00, 0xd7a3}, {0xf900, 0xfaff}, {0xfe30, 0xfe4f}, {0xff00, 0xff60}, {0xffe0, 0xffe6},
+        {0x1f300, 0x1f64f}, {0x1f680, 0x1f6ff}, {0x1f900, 0x1f9ff}, {0x1fa70, 0x1faff}, {0x20000, 0x3fffd},
+    };
+    if (cp < 0x300) return 1;
+    for (const auto& r : ZERO)
+        if (cp >= r[0] && cp <= r[1]) return 0;
+    for (const auto& r : WIDE)
+        if (cp >= r[0] && cp <= r[1]) return 2;
+    return 1;
+}
+
+// Length in bytes of the longest prefix of s that fits in max_cells, and its
+// width. Marks stay with the character before them; an emoji variation
+// selector (U+FE0F) widens that character to two cells, so it fits whole or
+// is cut off whole.
+static size_t fit_cells(std::string_view s, size_t max_cells, size_t& width) {
+    size_t used = 0, end = 0;
+    size_t base_start = 0, base_cells = 0;     // the last character with a width
+    for (size_t i = 0; i < s.size();) {
+        const size_t start = i;
+        const uint32_t cp = next_code_point(s, i);
+        size_t w = static_cast<size_t>(cells(cp));
+        if (cp == 0xfe0f && base_cells == 1) {
+            if (used + 1 > max_cells) {
+                used -= 1;
+                end = base_start;
+                break;
+            }
+            base_cells = 2;
+            w = 1;
+        } else if (w > 0) {
+            if (used + w > max_cells) break;
+            base_start = start;
+            base_cells = w;
+        }
+        used += w;
+        end = i;
+    }
+    width = used;
+    return end;
+}
+
+static size_t display_width(std::string_view s) {
+    size_t width = 0;
+    bool ascii = true;
+    for (char c : s) ascii &= static_cast<unsigned char>(c) < 0x80;
+    if (ascii) return s.size();
+    fit_cells(s, SIZE_MAX, width);
+    return width;
+}
+
+void append_fitted(std::string& out, std::string_view text, size_t columns) {
+    size_t width = 0;
+    out += text.substr(0, fit_cells(text, columns, width));
+}
+
+static void append_padded(std::string& out, std::string_view text, size_t columns) {
+    out += text;
+    const size_t width = display_width(text);
+    if (width < columns) out.append(columns - width, ' ');
+}
+
+template <class T>
+static void append_right(std::string& out, T v, size_t columns) {
+    char buf[32];
+    const size_t n = static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+    if (n < columns) out.append(columns - n, ' ');
+    out.append(buf, n);
+}
+
+static void append_right_fixed1(std::string& out, double v, size_t columns) {
+    char buf[64];
+    const size_t n = static_cast<size_t>(std::to_chars(buf, buf + sizeof(buf), v, std::chars_format::fixed, 1).ptr - buf);
+    if (n < columns) out.append(columns - n, ' ');
+    out.append(buf, n);
+}
+
+// Result rows, by column: timestamp, id, HTTP code, bytes, elapsed, verdict,
+// detail. Widths are terminal cells, so the emoji in the verdicts keep the
+// detail column aligned.
+static const size_t ID_COLUMNS = 15;
+static const size_t CODE_COLUMNS = 4;
+static const size_t BYTES_COLUMNS = 8;
+static const size_t ELAPSED_COLUMNS = 10;
+static const size_t STATUS_COLUMNS = 20;
+
+// Verdict texts cut to STATUS_COLUMNS ("..." marks a cut) and padded, once.
+struct VerdictCells {
+    std::string cell[static_cast<size_t>(Verdict::Count)];
+
+    VerdictCells() {
+        for (size_t v = 0; v < static_cast<size_t>(Verdict::Count); ++v) {
+            const std::string_view text = VERDICT_TEXT[v];
+            std::string& c = cell[v];
+            size_t width = 0;
+            const size_t fits = fit_cells(text, STATUS_COLUMNS, width);
+            if (fits == text.size()) {
+                c = text;
+            } else {
+                c = text.substr(0, fit_cells(text, STATUS_COLUMNS - 3, width));
+                c += "...";
+                width += 3;
+            }
+            c.append(STATUS_COLUMNS - width, ' ');
+        }
+    }
+};
+
+static const VerdictCells VERDICT_CELLS;
+
+void log_line(Logger& log, const std::string& s) { log.write(LogKind::Line, s); }
+void log_inline(Logger& log, const std::string& s) {
+    if (log.progress) log.write(LogKind::Inline, s);
+}
+
+void log_start(Logger& log, std::string_view id, std::string_view url) {
+    if (!log.enabled() || !log.progress) return;
+    std::string& line = line_buffer();
+    append_timestamp(line);
+    line += ' ';
+    line += id;
+    line += " - Starting request -> ";
+    line += url;
+    log_inline(log, line);
+}
+
+void log_msg(Logger& log, std::string_view prefix, std::string_view msg) {
+    if (!log.enabled()) return;
+    std::string& line = line_buffer();
+    append_timestamp(line);
+    line += ' ';
+    if (!prefix.empty()) {
+        line += prefix;
+        line += " - ";
+    }
+    line += msg;
+    log.write(LogKind::Message, line);
+}
+
+void log_result(Logger& log, const ResultStore& store, size_t i, std::string_view id) {
+    if (!log.enabled()) return;
+    std::string& line = line_buffer();
+    append_timestamp(line);
+    line += ' ';
+    append_padded(line, id, ID_COLUMNS);
+    line += ' ';
+    append_right(line, store.http_code[i], CODE_COLUMNS);
+    line += ' ';
+    append_right(line, store.kind[i] == ProbeKind::Upload ? store.uploaded[i] : store.received[i], BYTES_COLUMNS);
+    line += ' ';
+    append_right_fixed1(line, store.elapsed_ms[i], ELAPSED_COLUMNS);
+    line += " ms ";
+    line += VERDICT_CELLS.cell[static_cast<size_t>(store.verdict[i])];
+    line += ' ';
+    append_detail_text(line, store.detail[i], store.curl_code[i]);
+    log_line(log, line);
+}
+
+} // namespace dpi
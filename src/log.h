@@ -0,0 +1,83 @@
+// log.h - status line output
+#pragma once
+
+#include "cpu.h"
+#include "types.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+
+namespace dpi {
+
+// Line: a finished status line. Inline: a progress line that the next write
+// overwrites. Message: a plain prefixed message.
+enum class LogKind { Line, Inline, Message };
+
+using LogSink = void (*)(LogKind kind, const char* text, void* user);
+// Called after every batch of lines, so a sink can buffer them and write
+// them out in one go.
+using LogFlush = void (*)(void* user);
+
+// The CLI writes to the terminal; library users install their own sink or
+// none at all, in which case nothing is formatted. stdout_sink only buffers;
+// stdout_flush writes what it buffered. plain_sink is stdout_sink for pipes
+// and files: one line per row or message, no progress lines, no escapes.
+void stdout_sink(LogKind kind, const char* text, void* user);
+void plain_sink(LogKind kind, const char* text, void* user);
+void stdout_flush(void* user);
+
+// Between start() and stop() lines are queued and handed to the sink by a
+// logger thread, so the reactors never wait on the terminal; outside a run
+// write() calls the sink directly. Either way the sink sees one line at a
+// time, in the order they were written.
+struct Logger {
+    std::mutex mtx;
+    LogSink sink = stdout_sink;
+    LogFlush flush = stdout_flush;
+    void* user = nullptr;
+    // Off: progress lines (log_start, log_inline) are not even formatted.
+    bool progress = true;
+
+    std::condition_variable cv;
+    // Queued lines packed as "<kind><text>\0". The logger thread swaps queue
+    // with batch, so both keep their capacity and a warm logger queues a line
+    // without allocating.
+    std::string queue;
+    std::string batch;
+    std::thread thread;
+    bool async = false;
+    bool stopping = false;
+    int cpu = -1;           // the logger thread is pinned here by start()
+    Placement placement;    // where the last logger thread ran
+
+    Logger() = default;
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+    ~Logger() { stop(); }
+
+    bool enabled() const { return sink != nullptr; }
+    void write(LogKind kind, const std::string& s);
+    void start();
+    // Writes out everything queued and joins the logger thread.
+    void stop();
+};
+
+std::string currentTimestamp();
+// "[HH:MM:SS.mmm]" (UTC) appended to out.
+void append_timestamp(std::string& out);
+
+// Appends the longest prefix of text that fits in columns terminal cells;
+// wide characters and emoji count as two.
+void append_fitted(std::string& out, std::string_view text, size_t columns);
+
+void log_line(Logger& log, const std::string& s);
+void log_inline(Logger& log, const std::string& s);
+// The progress line of a probe that is starting to fetch url.
+void log_start(Logger& log, std::string_view id, std::string_view url);
+void log_msg(Logger& log, std::string_view prefix, std::string_view msg);
+void log_result(Logger& log, const ResultStore& store, size_t i, std::string_view id);
+
+} // namespace dpi
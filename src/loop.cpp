@@ -0,0 +1,446 @@
+// loop.cpp - epoll/timerfd event loop driving curl_multi_socket_action
+
+#include "loop.h"
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+
+using namespace std::chrono;
+
+namespace dpi {
+
+// epoll data: multi id in the high half, socket in the low half. Id 0 is the
+// loop's timerfd. Looking the multi up by id (instead of storing a pointer)
+// keeps events that are still queued for a multi that has gone away harmless.
+static uint64_t watch_key(uint32_t multi_id, curl_socket_t fd) {
+    return (static_cast<uint64_t>(multi_id) << 32) | static_cast<uint32_t>(fd);
+}
+
+static int socket_cb(CURL*, curl_socket_t fd, int what, void* userp, void*) {
+    Multi* m = static_cast<Multi*>(userp);
+    const int epfd = m->loop.epfd;
+    std::vector<uint32_t>& watched = m->loop.watched;
+    if (what == CURL_POLL_REMOVE) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, fd, nullptr);
+        if (static_cast<size_t>(fd) < watched.size() && watched[fd] == m->id) watched[fd] = 0;
+        return 0;
+    }
+    epoll_event ev{};
+    ev.events = (what & CURL_POLL_IN ? EPOLLIN : 0u) | (what & CURL_POLL_OUT ? EPOLLOUT : 0u);
+    ev.data.u64 = watch_key(m->id, fd);
+    if (static_cast<size_t>(fd) >= watched.size()) watched.resize(fd + 1);
+    const bool added = watched[fd] != m->id;
+    watched[fd] = m->id;
+    if (epoll_ctl(epfd, added ? EPOLL_CTL_ADD : EPOLL_CTL_MOD, fd, &ev) != 0) {
+        // Registered under another multi before a close, or closed and reused.
+        epoll_ctl(epfd, errno == EEXIST ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    }
+    return 0;
+}
+
+static int timer_cb(CURLM*, long timeout_ms, void* userp) {
+    static_cast<Multi*>(userp)->set_timer(timeout_ms);
+    return 0;
+}
+
+static void multi_timer_fire(TimerNode&, void* arg) {
+    static_cast<Multi*>(arg)->socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+static thread_local FramePool* current_pool = nullptr;
+
+FramePool::~FramePool() {
+    for (auto& list : free)
+        for (void* p : list) ::operator delete(p);
+}
+
+void* FramePool::allocate(size_t n) {
+    const size_t c = (n + GRANULE - 1) / GRANULE - 1;
+    if (c >= CLASSES) return ::operator new(n);
+    FramePool* pool = current_pool;
+    if (pool && !pool->free[c].empty()) {
+        void* p = pool->free[c].back();
+        pool->free[c].pop_back();
+        return p;
+    }
+    return ::operator new((c + 1) * GRANULE);
+}
+
+void FramePool::release(void* p, size_t n) noexcept {
+    const size_t c = (n + GRANULE - 1) / GRANULE - 1;
+    FramePool* pool = current_pool;
+    if (c >= CLASSES || !pool) {
+        ::operator delete(p);
+        return;
+    }
+    try {
+        pool->free[c].push_back(p);
+    } catch (...) {
+        ::operator delete(p);
+    }
+}
+
+FramePool::Scope::Scope(FramePool& pool) : prev(current_pool) { current_pool = &pool; }
+FramePool::Scope::~Scope() { current_pool = prev; }
+
+void TimerNode::cancel() {
+    if (!wheel) return;
+    *pprev = next;
+    if (next) next->pprev = pprev;
+    wheel->count--;
+    if (level >= 0) wheel->level_count[level]--;
+    wheel = nullptr;
+    next = nullptr;
+    pprev = nullptr;
+}
+
+TimerWheel::~TimerWheel() {
+    // Owners normally cancel first; detach whatever is left so their
+    // destructors do not touch a dead wheel.
+    auto detach = [](TimerNode* n) {
+        while (n) {
+            TimerNode* next = n->next;
+            n->wheel = nullptr;
+            n->next = nullptr;
+            n->pprev = nullptr;
+            n = next;
+        }
+    };
+    for (auto& level : slots)
+        for (TimerNode* head : level) detach(head);
+    detach(overdue);
+}
+
+uint64_t TimerWheel::tick_of(Clock::time_point t) const {
+    if (t <= epoch) return 0;
+    const auto ns = duration_cast<nanoseconds>(t - epoch).count();
+    return static_cast<uint64_t>((ns + 999999) / 1000000);
+}
+
+void TimerWheel::link(TimerNode*& head, TimerNode& n) {
+    n.next = head;
+    if (head) head->pprev = &n.next;
+    head = &n;
+    n.pprev = &head;
+}
+
+void TimerWheel::place(TimerNode& n) {
+    if (n.expires <= current) {
+        n.level = -1;
+        link(overdue, n);
+        return;
+    }
+    static const uint64_t RANGE = uint64_t{1} << (SLOT_BITS * LEVELS);
+    if (n.expires - current >= RANGE) n.expires = current + RANGE - 1;
+    const uint64_t delta = n.expires - current;
+    int level = 0;
+    while (level < LEVELS - 1 && delta >= (uint64_t{1} << (SLOT_BITS * (level + 1)))) level++;
+    n.level = level;
+    level_count[level]++;
+    link(slots[level][(n.expires >> (SLOT_BITS * level)) & (SLOTS - 1)], n);
+}
+
+void TimerWheel::schedule(TimerNode& n, Clock::time_point deadline) {
+    n.cancel();
+    n.wheel = this;
+    n.expires = tick_of(deadline);
+    count++;
+    place(n);
+}
+
+void TimerWheel::schedule_now(TimerNode& n) {
+    n.cancel();
+    n.wheel = this;
+    n.expires = current;
+    count++;
+    place(n);
+}
+
+// Moves the slot of level that the current tick has reached one level down,
+// higher levels first when their slot comes up too.
+void TimerWheel::cascade(int level) {
+    const uint64_t idx = (current >> (SLOT_BITS * level)) & (SLOTS - 1);
+    if (idx == 0 && level + 1 < LEVELS) cascade(level + 1);
+    TimerNode* list = std::exchange(slots[level][idx], nullptr);
+    while (list) {
+        TimerNode* n = list;
+        list = n->next;
+        level_count[level]--;
+        if (n->expires == current) {
+            // Due on the tick being processed: join the slot that fires next.
+            n->level = 0;
+            level_count[0]++;
+            link(slots[0][current & (SLOTS - 1)], *n);
+        } else {
+            place(*n);
+        }
+    }
+}
+
+// Fires the entries on the list when called. Callbacks may cancel entries
+// that are still pending here or schedule new ones, which wait for the next
+// pass instead of growing this one.
+void TimerWheel::fire_list(TimerNode*& head) {
+    TimerNode* pending = std::exchange(head, nullptr);
+    if (pending) pending->pprev = &pending;
+    while (pending) {
+        TimerNode& n = *pending;
+        n.cancel();
+        n.fire(n, n.arg);
+    }
+}
+
+void TimerWheel::advance(Clock::time_point now) {
+    fire_list(overdue);
+    const uint64_t target = now <= epoch ? 0 : static_cast<uint64_t>(duration_cast<milliseconds>(now - epoch).count());
+    while (current < target) {
+        if (count == 0) {
+            current = target;
+            break;
+        }
+        // Nothing on level 0: skip to the end of its turn, where the next
+        // cascade happens.
+        if (level_count[0] == 0) current = std::min(target, current | (SLOTS - 1));
+        if (current == target) break;
+        ++current;
+        if ((current & (SLOTS - 1)) == 0) cascade(1);
+        fire_list(slots[0][current & (SLOTS - 1)]);
+    }
+}
+
+bool TimerWheel::next_tick(uint64_t& tick) const {
+    if (overdue) {
+        tick = current;
+        return true;
+    }
+    bool found = false;
+    for (int level = 0; level < LEVELS; ++level) {
+        if (level_count[level] == 0) continue;
+        const int shift = SLOT_BITS * level;
+        const uint64_t turn = current >> shift;
+        for (uint64_t k = 1; k <= SLOTS; ++k) {
+            if (!slots[level][(turn + k) & (SLOTS - 1)]) continue;
+            // Level 0 holds exact ticks; higher levels wake the loop when
+            // the slot cascades.
+            const uint64_t t = (turn + k) << shift;
+            if (!found || t < tick) tick = t;
+            found = true;
+            break;
+        }
+    }
+    return found;
+}
+
+Multi::Multi(EventLoop& l) : loop(l), timer(multi_timer_fire, this) {
+    id = loop.next_multi_id++;
+    loop.multis[id] = this;
+    multi = curl_multi_init();
+    if (!multi) return;
+    curl_multi_setopt(multi, CURLMOPT_SOCKETFUNCTION, socket_cb);
+    curl_multi_setopt(multi, CURLMOPT_SOCKETDATA, this);
+    curl_multi_setopt(multi, CURLMOPT_TIMERFUNCTION, timer_cb);
+    curl_multi_setopt(multi, CURLMOPT_TIMERDATA, this);
+}
+
+Multi::~Multi() {
+    if (multi) curl_multi_cleanup(multi);   // may still call socket_cb/timer_cb
+    set_timer(-1);
+    for (size_t fd = 0; fd < loop.watched.size(); ++fd) {
+        if (loop.watched[fd] != id) continue;
+        epoll_ctl(loop.epfd, EPOLL_CTL_DEL, static_cast<int>(fd), nullptr);
+        loop.watched[fd] = 0;
+    }
+    loop.multis.erase(id);
+}
+
+// curl asks for 0 ms whenever it has work to do right away; that skips the
+// wheel's tick rounding.
+void Multi::set_timer(long timeout_ms) {
+    if (timeout_ms < 0) {
+        timer.cancel();
+    } else if (timeout_ms == 0) {
+        loop.wheel.schedule_now(timer);
+    } else {
+        loop.wheel.schedule(timer, steady_clock::now() + milliseconds(timeout_ms));
+    }
+}
+
+bool Multi::Transfer::await_suspend(std::coroutine_handle<> h) {
+    waiter = h;
+    curl_easy_setopt(easy, CURLOPT_PRIVATE, this);
+    if (!multi.multi || curl_multi_add_handle(multi.multi, easy) != CURLM_OK) {
+        rc = CURLE_FAILED_INIT;
+        done = true;
+        return false;
+    }
+    attached = true;
+    return true;
+}
+
+CURLcode Multi::Transfer::await_resume() noexcept {
+    if (attached) {
+        curl_multi_remove_handle(multi.multi, easy);
+        attached = false;
+    }
+    return rc;
+}
+
+void Multi::Transfer::finish(CURLcode result) {
+    if (done) return;
+    done = true;
+    rc = result;
+    multi.loop.post(waiter);
+}
+
+void Multi::socket_action(curl_socket_t fd, int flags) {
+    int running = 0;
+    curl_multi_socket_action(multi, fd, flags, &running);
+    CURLMsg* msg;
+    int left = 0;
+    while ((msg = curl_multi_info_read(multi, &left))) {
+        if (msg->msg != CURLMSG_DONE) continue;
+        CURL* easy = msg->easy_handle;
+        const CURLcode rc = msg->data.result;
+        Transfer* t = nullptr;
+        curl_easy_getinfo(easy, CURLINFO_PRIVATE, &t);
+        curl_multi_remove_handle(multi, easy);
+        t->attached = false;
+        t->finish(rc);
+    }
+}
+
+// A loop is kept between runs; init() only does what is not done yet.
+bool EventLoop::init() {
+    if (epfd < 0) epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (epfd < 0) return false;
+    if (timerfd >= 0) return true;
+    timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timerfd < 0) return false;
+    epoll_event ev{};
+    ev.events = EPOLLIN;
+    ev.data.u64 = 0;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev) == 0) return true;
+    ::close(timerfd);
+    timerfd = -1;
+    return false;
+}
+
+EventLoop::~EventLoop() {
+    if (timerfd >= 0) ::close(timerfd);
+    if (epfd >= 0) ::close(epfd);
+}
+
+static void sleep_fire(TimerNode&, void* arg) {
+    EventLoop::Sleep* s = static_cast<EventLoop::Sleep*>(arg);
+    s->loop.post(s->waiter);
+}
+
+void EventLoop::Sleep::await_suspend(std::coroutine_handle<> h) {
+    waiter = h;
+    node.fire = sleep_fire;
+    node.arg = this;
+    loop.wheel.schedule(node, until);
+}
+
+// The root of a spawned task. It starts when the loop first resumes it and
+// frees its own frame (and with it the task's) when done, so a finished
+// probe's frames go back to the pool while the run goes on.
+struct Detached {
+    struct promise_type {
+        Detached get_return_object() { return {std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+        static void* operator new(size_t n) { return FramePool::allocate(n); }
+        static void operator delete(void* p, size_t n) noexcept { FramePool::release(p, n); }
+    };
+
+    std::coroutine_handle<promise_type> h;
+};
+
+static Detached run_root(EventLoop& loop, Task t) {
+    co_await t;
+    loop.active--;
+}
+
+void EventLoop::spawn(Task t) {
+    active++;
+    post(run_root(*this, std::move(t)).h);
+}
+
+void EventLoop::run() {
+    epoll_event events[256];
+    for (;;) {
+        const bool more = feed && feed();
+        while (!ready.empty()) {
+            running.swap(ready);
+            for (std::coroutine_handle<> h : running) h.resume();
+            running.clear();
+        }
+        if (active == 0) {
+            if (!more) break;
+            continue;
+        }
+
+        wheel.advance(Clock::now());
+        if (!ready.empty() || wheel.overdue) continue;
+
+        // steady_clock is CLOCK_MONOTONIC, so deadlines arm the timerfd as is.
+        itimerspec its{};
+        uint64_t tick = 0;
+        if (wheel.next_tick(tick)) {
+            const auto ns = duration_cast<nanoseconds>(wheel.time_of(tick).time_since_epoch()).count();
+            its.it_value.tv_sec = ns / 1000000000;
+            its.it_value.tv_nsec = ns % 1000000000;
+            if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) its.it_value.tv_nsec = 1;
+        }
+        timerfd_settime(timerfd, TFD_TIMER_ABSTIME, &its, nullptr);
+
+        const int n = epoll_wait(epfd, events, 256, more ? 0 : -1);
+        for (int i = 0; i < n; ++i) {
+            const uint64_t key = events[i].data.u64;
+            if (key == 0) {
+                uint64_t expirations;
+                [[maybe_unused]] ssize_t r = ::read(timerfd, &expirations, sizeof(expirations));
+                continue;
+            }
+            auto it = multis.find(static_cast<uint32_t>(key >> 32));
+            if (it == multis.end()) continue;
+            const uint32_t ev = events[i].events;
+            const int flags = (ev & EPOLLIN ? CURL_CSELECT_IN : 0) | (ev & EPOLLOUT ? CURL_CSELECT_OUT : 0) |
+                              (ev & (EPOLLERR | EPOLLHUP) ? CURL_CSELECT_ERR : 0);
+            it->second->socket_action(static_cast<curl_socket_t>(static_cast<uint32_t>(key)), flags);
+        }
+    }
+}
+
+struct JoinState {
+    size_t pending = 0;
+    std::coroutine_handle<> waiter;
+};
+
+struct JoinAwaiter {
+    JoinState& j;
+
+    bool await_ready() const noexcept { return j.pending == 0; }
+    void await_suspend(std::coroutine_handle<> h) noexcept { j.waiter = h; }
+    void await_resume() const noexcept {}
+};
+
+static Task join_one(EventLoop& loop, Task t, JoinState& j) {
+    co_await t;
+    if (--j.pending == 0 && j.waiter) loop.post(j.waiter);
+}
+
+Task when_all(EventLoop& loop, std::vector<Task> tasks) {
+    JoinState j;
+    j.pending = tasks.size();
+    for (Task& t : tasks) loop.spawn(join_one(loop, std::move(t), j));
+    co_await JoinAwaiter{j};
+}
+
+} // namespace dpi
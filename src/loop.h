@@ -0,0 +1,236 @@
+// loop.h - per-thread event loop and coroutines for the probes
+#pragma once
+
+#include <curl/curl.h>
+#include <chrono>
+#include <coroutine>
+#include <cstdint>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace dpi {
+
+// Recycled coroutine frames, by 64-byte size class. A reactor installs its
+// pool for its thread with Scope; frames then come from and go back to the
+// pool, so a steady stream of probes stops allocating once the pool holds as
+// many frames as were ever alive at once. Without a pool, or for frames
+// above 2 KiB, it is plain operator new. Frames never change threads, so the
+// pool needs no lock; a frame may come from the heap and go to a pool or the
+// other way round.
+struct FramePool {
+    static const size_t GRANULE = 64;
+    static const size_t CLASSES = 32;
+    std::vector<void*> free[CLASSES];
+
+    FramePool() = default;
+    FramePool(const FramePool&) = delete;
+    FramePool& operator=(const FramePool&) = delete;
+    ~FramePool();
+
+    static void* allocate(size_t n);
+    static void release(void* p, size_t n) noexcept;
+
+    struct Scope {
+        FramePool* prev;
+        explicit Scope(FramePool& pool);
+        ~Scope();
+    };
+};
+
+// A lazily started coroutine. co_await runs it and resumes the awaiter when
+// it returns; EventLoop::spawn runs it detached.
+struct Task {
+    struct promise_type {
+        std::coroutine_handle<> continuation;
+
+        Task get_return_object() { return Task{std::coroutine_handle<promise_type>::from_promise(*this)}; }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        struct FinalAwaiter {
+            bool await_ready() noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> c = h.promise().continuation;
+                return c ? c : std::noop_coroutine();
+            }
+            void await_resume() noexcept {}
+        };
+        FinalAwaiter final_suspend() noexcept { return {}; }
+        void return_void() {}
+        void unhandled_exception() { std::terminate(); }
+        static void* operator new(size_t n) { return FramePool::allocate(n); }
+        static void operator delete(void* p, size_t n) noexcept { FramePool::release(p, n); }
+    };
+
+    std::coroutine_handle<promise_type> h;
+
+    explicit Task(std::coroutine_handle<promise_type> h) : h(h) {}
+    Task(Task&& o) noexcept : h(std::exchange(o.h, {})) {}
+    Task& operator=(Task&&) = delete;
+    ~Task() {
+        if (h) h.destroy();
+    }
+
+    bool await_ready() const noexcept { return !h || h.done(); }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        h.promise().continuation = awaiting;
+        return h;
+    }
+    void await_resume() const noexcept {}
+};
+
+struct TimerWheel;
+
+// A timeout embedded in whatever it times out (a multi, a sleeping
+// coroutine, a probe). fire runs once when it expires; a node unlinks itself
+// when destroyed, so an owner going away never leaves a dangling entry.
+struct TimerNode {
+    TimerNode* next = nullptr;
+    TimerNode** pprev = nullptr;    // the pointer that points here
+    TimerWheel* wheel = nullptr;    // set while scheduled
+    uint64_t expires = 0;           // wheel tick
+    int level = -1;                 // -1: on the overdue list
+    void (*fire)(TimerNode& node, void* arg) = nullptr;
+    void* arg = nullptr;
+
+    TimerNode() = default;
+    TimerNode(void (*fire)(TimerNode&, void*), void* arg) : fire(fire), arg(arg) {}
+    TimerNode(const TimerNode&) = delete;
+    TimerNode& operator=(const TimerNode&) = delete;
+    ~TimerNode() { cancel(); }
+
+    bool scheduled() const { return wheel != nullptr; }
+    void cancel();
+};
+
+// Hashed hierarchical timer wheel with 1 ms ticks: LEVELS levels of 64
+// slots, level L holding what expires within 64^(L+1) ticks. Scheduling and
+// cancelling are O(1) list operations; an entry is moved down a level at
+// most LEVELS - 1 times before it fires. Deadlines beyond the top level's
+// ~4.6 h range are clamped to it.
+struct TimerWheel {
+    using Clock = std::chrono::steady_clock;
+    static const int LEVELS = 4;
+    static const int SLOT_BITS = 6;
+    static const uint64_t SLOTS = 1u << SLOT_BITS;
+
+    Clock::time_point epoch = Clock::now();
+    uint64_t current = 0;       // last tick processed
+    size_t count = 0;
+    size_t level_count[LEVELS] = {};
+    TimerNode* slots[LEVELS][SLOTS] = {};
+    TimerNode* overdue = nullptr;   // fires on the next advance()
+
+    TimerWheel() = default;
+    TimerWheel(const TimerWheel&) = delete;
+    TimerWheel& operator=(const TimerWheel&) = delete;
+    ~TimerWheel();
+
+    // Ticks round up, so nothing fires before its deadline.
+    uint64_t tick_of(Clock::time_point t) const;
+    Clock::time_point time_of(uint64_t tick) const { return epoch + std::chrono::milliseconds(tick); }
+
+    void schedule(TimerNode& n, Clock::time_point deadline);
+    void schedule_now(TimerNode& n);
+    // Fires everything due up to now, overdue entries first.
+    void advance(Clock::time_point now);
+    // Earliest tick at which advance() has work: exact for entries within
+    // 64 ms, otherwise the tick at which the next populated slot cascades.
+    // False if nothing is scheduled.
+    bool next_tick(uint64_t& tick) const;
+
+    void link(TimerNode*& head, TimerNode& n);
+    void place(TimerNode& n);
+    void cascade(int level);
+    void fire_list(TimerNode*& head);
+};
+
+struct EventLoop;
+
+// One curl multi handle driven by the loop through curl_multi_socket_action.
+// Its sockets are watched by the loop's epoll, its timeout is a wheel entry.
+struct Multi {
+    EventLoop& loop;
+    CURLM* multi = nullptr;
+    uint32_t id = 0;
+    TimerNode timer;
+
+    // Suspends the calling coroutine until the transfer is done. finish()
+    // ends it early (a probe timer, a callback that has seen enough); the
+    // handle is then taken off the multi when the coroutine resumes, outside
+    // any curl callback.
+    struct Transfer {
+        Multi& multi;
+        CURL* easy;
+        CURLcode rc = CURLE_OK;
+        std::coroutine_handle<> waiter;
+        bool attached = false;
+        bool done = false;
+
+        bool await_ready() noexcept { return false; }
+        bool await_suspend(std::coroutine_handle<> h);
+        CURLcode await_resume() noexcept;
+        void finish(CURLcode result);
+    };
+
+    explicit Multi(EventLoop& loop);
+    Multi(const Multi&) = delete;
+    Multi& operator=(const Multi&) = delete;
+    ~Multi();
+
+    Transfer transfer(CURL* easy) { return Transfer{*this, easy, CURLE_OK, {}, false, false}; }
+    void set_timer(long timeout_ms);
+    // Hands a socket event (or CURL_SOCKET_TIMEOUT) to curl and resumes the
+    // coroutines whose transfers finished.
+    void socket_action(curl_socket_t fd, int flags);
+};
+
+struct EventLoop {
+    using Clock = std::chrono::steady_clock;
+
+    int epfd = -1;
+    int timerfd = -1;
+    size_t active = 0;                       // spawned tasks still running
+    // Coroutines to resume. run() swaps in running and drains it, so what
+    // they post waits for the next pass and neither vector shrinks.
+    std::vector<std::coroutine_handle<>> ready;
+    std::vector<std::coroutine_handle<>> running;
+    TimerWheel wheel;
+    std::unordered_map<uint32_t, Multi*> multis;   // by id, see epoll data
+    std::vector<uint32_t> watched;  // by fd: id of the multi it is registered for, 0 if none
+    uint32_t next_multi_id = 1;
+    // Called at the top of every iteration to spawn more work. Returning true
+    // means work is still queued: the loop then only polls for events instead
+    // of blocking, and does not stop while nothing is running.
+    std::function<bool()> feed;
+
+    struct Sleep {
+        EventLoop& loop;
+        Clock::time_point until;
+        TimerNode node;
+        std::coroutine_handle<> waiter;
+
+        bool await_ready() const noexcept { return until <= Clock::now(); }
+        void await_suspend(std::coroutine_handle<> h);
+        void await_resume() const noexcept {}
+    };
+
+    EventLoop() = default;
+    EventLoop(const EventLoop&) = delete;
+    EventLoop& operator=(const EventLoop&) = delete;
+    ~EventLoop();
+
+    bool init();
+    void spawn(Task t);
+    void post(std::coroutine_handle<> h) { ready.push_back(h); }
+    Sleep sleep(std::chrono::milliseconds d) { return Sleep{*this, Clock::now() + d, {}, {}}; }
+    // Runs until every spawned task has finished and feed has nothing left.
+    void run();
+};
+
+// Runs the tasks concurrently on the loop and completes after the last one.
+Task when_all(EventLoop& loop, std::vector<Task> tasks);
+
+} // namespace dpi
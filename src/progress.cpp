@@ -0,0 +1,32 @@
+// progress.cpp - live state of a run, for dashboards
+
+#include "progress.h"
+
+namespace dpi {
+
+void Progress::reset(size_t slots) {
+    phase = std::make_unique<std::atomic<uint8_t>[]>(slots);
+    for (size_t i = 0; i < slots; ++i) phase[i].store(static_cast<uint8_t>(Phase::Queued), std::memory_order_relaxed);
+    for (auto& n : in_phase) n.store(0, std::memory_order_relaxed);
+    for (auto& n : verdicts) n.store(0, std::memory_order_relaxed);
+    bytes.store(0, std::memory_order_relaxed);
+    in_phase[static_cast<size_t>(Phase::Queued)].store(slots, std::memory_order_relaxed);
+    total.store(slots, std::memory_order_release);
+}
+
+// The slot's old phase comes from the array, so a repeated or skipped
+// transition (a retry, a probe that never connected) keeps the counts right.
+void Progress::set(size_t slot, Phase p) {
+    const auto old = phase[slot].exchange(static_cast<uint8_t>(p), std::memory_order_relaxed);
+    if (old == static_cast<uint8_t>(p)) return;
+    in_phase[old].fetch_sub(1, std::memory_order_relaxed);
+    in_phase[static_cast<size_t>(p)].fetch_add(1, std::memory_order_relaxed);
+}
+
+void Progress::finish(size_t slot, Verdict v, uint64_t moved) {
+    bytes.fetch_add(moved, std::memory_order_relaxed);
+    verdicts[static_cast<size_t>(v)].fetch_add(1, std::memory_order_relaxed);
+    set(slot, Phase::Done);
+}
+
+} // namespace dpi
@@ -0,0 +1,35 @@
+// progress.h - live state of a run, for dashboards
+#pragma once
+
+#include "types.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace dpi {
+
+enum class Phase : uint8_t { Queued, Connecting, Transferring, Done, Count };
+
+inline constexpr const char* PHASE_TEXT[] = {"queued", "connecting", "transferring", "done"};
+
+// Per-slot phase plus counters the reactors keep up to date as probes move
+// along, so a reader (the dashboard) gets the whole picture from a fixed
+// number of loads however many probes run. Off unless enabled is set before
+// run_suite; then every update is one branch.
+struct Progress {
+    bool enabled = false;
+    std::atomic<size_t> total{0};
+    std::atomic<size_t> in_phase[static_cast<size_t>(Phase::Count)] = {};
+    std::atomic<size_t> verdicts[static_cast<size_t>(Verdict::Count)] = {};
+    std::atomic<uint64_t> bytes{0};     // moved by finished probes
+    std::unique_ptr<std::atomic<uint8_t>[]> phase;
+
+    // Every slot queued. Called by run_suite before any probe starts.
+    void reset(size_t slots);
+    void set(size_t slot, Phase p);
+    void finish(size_t slot, Verdict v, uint64_t moved);
+};
+
+} // namespace dpi
@@ -0,0 +1,359 @@
+// report.cpp - NDJSON export and run-to-run diffs
+
+#include "report.h"
+#include "history.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+
+namespace dpi {
+
+void append_ndjson_row(std::string& out, const ResultRow& r) {
+    std::string node;
+    if (!r.node.empty()) node = std::format("\"node\":\"{}\",", json_escape(r.node));
+    out += std::format(
+        "{{\"ts\":{},\"round\":{},{}\"id\":\"{}\",\"provider\":\"{}\",\"rep\":{},\"ip\":\"{}\",\"pinned\":{},"
+        "\"kind\":\"{}\",\"http_code\":{},\"received\":{},\"uploaded\":{},\"elapsed_ms\":{:.1f},\"stall_ms\":{:.1f},"
+        "\"verdict\":\"{}\",\"detail\":\"{}\",\"curl_code\":{}}}\n",
+        r.ts_ms, r.round, node, json_escape(r.id), json_escape(r.provider), r.rep, r.ip, r.pinned,
+        r.kind == ProbeKind::Upload ? "upload" : "download",
+        r.http_code, r.received, r.uploaded, r.elapsed_ms, r.stall_ms,
+        VERDICT_KEY[static_cast<size_t>(r.verdict)], json_escape(r.detail), r.curl_code);
+}
+
+bool append_ndjson(const Context& ctx, const std::string& path, int64_t ts_ms, uint32_t round) {
+    const ResultStore& store = ctx.store;
+    std::ofstream f(path, std::ios::app);
+    if (!f) return false;
+    std::string out;
+    for (size_t i = 0; i < store.count; ++i) {
+        const Test& t = ctx.tests[store.test[i]];
+        const std::string ip = ip_text(store.ip[i]), detail = detail_text(store, i);
+        ResultRow r;
+        r.node = ctx.cfg.node;
+        r.id = ctx.strings.str(t.id);
+        r.provider = ctx.strings.str(t.provider);
+        r.ip = ip;
+        r.detail = detail;
+        r.ts_ms = ts_ms;
+        r.round = round;
+        r.rep = store.rep[i];
+        r.pinned = store.target[i] != NO_TARGET;
+        r.kind = store.kind[i];
+        r.http_code = store.http_code[i];
+        r.received = store.received[i];
+        r.uploaded = store.uploaded[i];
+        r.elapsed_ms = store.elapsed_ms[i];
+        r.stall_ms = store.stall_ms[i];
+        r.verdict = store.verdict[i];
+        r.curl_code = store.curl_code[i];
+        append_ndjson_row(out, r);
+    }
+    f << out;
+    return f.good();
+}
+
+// Minimal field readers for the flat objects append_ndjson writes.
+std::string_view json_field(std::string_view obj, std::string_view key) {
+    size_t p = 0;
+    while ((p = obj.find(key, p)) != std::string_view::npos) {
+        if (p > 0 && obj[p - 1] == '"' && p + key.size() + 1 < obj.size() &&
+            obj[p + key.size()] == '"' && obj[p + key.size() + 1] == ':') {
+            p += key.size() + 2;
+            if (obj[p] == '"') {
+                size_t q = p + 1;
+                while (q < obj.size() && obj[q] != '"') q += obj[q] == '\\' ? 2 : 1;
+                return obj.substr(p + 1, q - p - 1);
+            }
+            size_t q = obj.find_first_of(",}", p);
+            return obj.substr(p, q == std::string_view::npos ? std::string_view::npos : q - p);
+        }
+        p += key.size();
+    }
+    return {};
+}
+
+double json_number(std::string_view v) {
+    double d = 0;
+    std::from_chars(v.data(), v.data() + v.size(), d);
+    return d;
+}
+
+// The comparison key of a result: test id, repetition and, for pinned probes,
+// the target address. This matches the id@rep/ip display id.
+std::string diff_key(std::string_view id, uint32_t rep, bool pinned, std::string_view ip) {
+    std::string key;
+    key.reserve(id.size() + ip.size() + 12);
+    key.append(id);
+    key += '@';
+    key += std::to_string(rep);
+    if (pinned) {
+        key += '/';
+        key.append(ip);
+    }
+    return key;
+}
+
+// True if the quote at q is preceded by an odd run of backslashes.
+static bool is_escaped(std::string_view s, size_t begin, size_t q) {
+    size_t n = 0;
+    while (q - n > begin && s[q - n - 1] == '\\') ++n;
+    return n % 2 == 1;
+}
+
+// Walks the "key":value pairs of one flat object as append_ndjson_row
+// writes it. String values are passed without their quotes, still escaped.
+template <class F>
+static void for_each_field(std::string_view obj, F&& f) {
+    size_t p = 0;
+    while ((p = obj.find('"', p)) != std::string_view::npos) {
+        size_t k = obj.find('"', p + 1);
+        if (k == std::string_view::npos || k + 1 >= obj.size() || obj[k + 1] != ':') return;
+        std::string_view key = obj.substr(p + 1, k - p - 1);
+        p = k + 2;
+        if (p < obj.size() && obj[p] == '"') {
+            size_t q = p;
+            do {
+                q = std::min(obj.find('"', q + 1), obj.size());
+            } while (q < obj.size() && is_escaped(obj, p + 1, q));
+            f(key, obj.substr(p + 1, q - p - 1));
+            p = q + 1;
+        } else {
+            size_t q = p;
+            while (q < obj.size() && obj[q] != ',' && obj[q] != '}') ++q;
+            f(key, obj.substr(p, q - p));
+            p = q;
+        }
+    }
+}
+
+template <class T>
+static T json_int(std::string_view v) {
+    T n = 0;
+    std::from_chars(v.data(), v.data() + v.size(), n);
+    return n;
+}
+
+static bool read_history(const MappedFile& f, const std::string& path, bool last_round,
+                         const std::function<void(const ResultRow&)>& fn) {
+    MappedFile strings;
+    if (!strings.map(path + ".strings")) return false;
+    auto str = [&](uint32_t off) {
+        return off < strings.size ? std::string_view(strings.data + off, strnlen(strings.data + off, strings.size - off))
+                                  : std::string_view();
+    };
+    HistoryHeader h;
+    std::memcpy(&h, f.data, sizeof(h));
+    auto rec = [&](size_t i) {
+        HistoryRecord r;
+        std::memcpy(&r, f.data + sizeof(HistoryHeader) + i * sizeof(HistoryRecord), sizeof(r));
+        return r;
+    };
+
+    const size_t n = (f.size - sizeof(HistoryHeader)) / sizeof(HistoryRecord);
+    size_t first = 0;
+    if (last_round && n > 0) {
+        const int64_t last_ts = rec(n - 1).ts_ms;
+        for (first = n; first > 0 && rec(first - 1).ts_ms == last_ts;) --first;
+    }
+    ResultRow row;
+    row.node = h.node != 0 ? str(h.node) : std::string_view();
+    std::string ip_str, curl_error;
+    for (size_t i = first; i < n; ++i) {
+        HistoryRecord r = rec(i);
+        if (r.id >= strings.size || r.verdict >= static_cast<uint8_t>(Verdict::Count) ||
+            r.detail >= std::size(DETAIL_TEXT)) {
+            continue;
+        }
+        IpAddr ip;
+        ip.family = r.ip_family;
+        std::memcpy(ip.bytes, r.ip, sizeof(ip.bytes));
+        ip_str = ip_text(ip);
+        row.id = str(r.id);
+        row.provider = str(r.provider);
+        row.ip = ip_str;
+        row.detail = r.detail == static_cast<uint8_t>(Detail::CurlError)
+            ? std::string_view(curl_error = detail_text(Detail::CurlError, r.curl_code))
+            : std::string_view(DETAIL_TEXT[r.detail]);
+        row.ts_ms = r.ts_ms;
+        row.round = r.round;
+        row.rep = r.rep;
+        row.pinned = r.pinned;
+        row.kind = static_cast<ProbeKind>(r.kind);
+        row.http_code = r.http_code;
+        row.received = r.received;
+        row.uploaded = r.uploaded;
+        row.elapsed_ms = r.elapsed_ms;
+        row.stall_ms = r.stall_ms;
+        row.verdict = static_cast<Verdict>(r.verdict);
+        row.curl_code = r.curl_code;
+        fn(row);
+    }
+    return true;
+}
+
+bool read_results(const std::string& path, bool last_round, const std::function<void(const ResultRow&)>& fn) {
+    MappedFile f;
+    if (!f.map(path)) return false;
+    std::string_view data(f.data, f.size);
+    if (data.size() >= sizeof(HistoryHeader) && std::memcmp(data.data(), HISTORY_MAGIC, 8) == 0) {
+        return read_history(f, path, last_round, fn);
+    }
+
+    // NDJSON is appended round by round: the last round is the trailing run
+    // of lines sharing one "ts".
+    size_t pos = 0;
+    if (last_round) {
+        std::string_view last_ts;
+        bool found = false;
+        for (size_t end = data.size(); end > 0;) {
+            const size_t e = end - (data[end - 1] == '\n');
+            const size_t nl = e == 0 ? std::string_view::npos : data.rfind('\n', e - 1);
+            const size_t b = nl == std::string_view::npos ? 0 : nl + 1;
+            std::string_view line = data.substr(b, e - b);
+            if (!line.empty()) {
+                std::string_view ts = json_field(line, "ts");
+                if (!found) {
+                    last_ts = ts;
+                    found = true;
+                } else if (ts != last_ts) {
+                    break;
+                }
+            }
+            pos = end = b;
+        }
+    }
+
+    std::string scratch[5];   // unescaped copies of string fields that need it
+    auto text = [&](std::string_view v, int k) -> std::string_view {
+        if (v.find('\\') == std::string_view::npos) return v;
+        return scratch[k] = json_unescape(v);
+    };
+    while (pos < data.size()) {
+        size_t nl = data.find('\n', pos);
+        if (nl == std::string_view::npos) nl = data.size();
+        std::string_view line = data.substr(pos, nl - pos);
+        pos = nl + 1;
+        if (line.empty()) continue;
+
+        ResultRow row;
+        bool valid = false;
+        for_each_field(line, [&](std::string_view key, std::string_view v) {
+            switch (key.empty() ? 0 : key[0]) {
+            case 't': if (key == "ts") row.ts_ms = json_int<int64_t>(v); break;
+            case 'n': if (key == "node") row.node = text(v, 0); break;
+            case 'i':
+                if (key == "id") row.id = text(v, 1);
+                else if (key == "ip") row.ip = text(v, 3);
+                break;
+            case 'p':
+                if (key == "provider") row.provider = text(v, 2);
+                else if (key == "pinned") row.pinned = v == "true";
+                break;
+            case 'r':
+                if (key == "round") row.round = json_int<uint32_t>(v);
+                else if (key == "rep") row.rep = json_int<uint32_t>(v);
+                else if (key == "received") row.received = json_int<uint64_t>(v);
+                break;
+            case 'k': if (key == "kind") row.kind = v == "upload" ? ProbeKind::Upload : ProbeKind::Download; break;
+            case 'h': if (key == "http_code") row.http_code = json_int<long>(v); break;
+            case 'u': if (key == "uploaded") row.uploaded = json_int<uint64_t>(v); break;
+            case 'e': if (key == "elapsed_ms") row.elapsed_ms = json_number(v); break;
+            case 's': if (key == "stall_ms") row.stall_ms = json_number(v); break;
+            case 'd': if (key == "detail") row.detail = text(v, 4); break;
+            case 'c': if (key == "curl_code") row.curl_code = json_int<int>(v); break;
+            case 'v':
+                if (key != "verdict") break;
+                for (size_t i = 0; i < static_cast<size_t>(Verdict::Count); ++i) {
+                    if (v == VERDICT_KEY[i]) {
+                        row.verdict = static_cast<Verdict>(i);
+                        valid = true;
+                    }
+                }
+                break;
+            }
+        });
+        if (valid) fn(row);
+    }
+    return true;
+}
+
+// Loads the most recent round of a results file for --diff-against.
+bool load_prior(const std::string& path, PriorIndex& index) {
+    std::error_code ec;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (!ec) index.reserve(size / 256);   // about one NDJSON line or three history records
+    return read_results(path, true, [&](const ResultRow& r) {
+        index[diff_key(r.id, r.rep, r.pinned, r.ip)] = {
+            r.verdict, r.kind == ProbeKind::Upload ? r.uploaded : r.received, static_cast<float>(r.elapsed_ms)};
+    });
+}
+
+// Pinned slots are keyed by the address they were pinned to, like
+// result_id; the address curl reports is empty if the connect failed.
+static std::string slot_key(const Context& ctx, size_t i) {
+    const ResultStore& store = ctx.store;
+    const Test& t = ctx.tests[store.test[i]];
+    const bool pinned = store.target[i] != NO_TARGET;
+    return diff_key(ctx.strings.str(t.id), store.rep[i], pinned,
+                    pinned ? ip_text(t.targets[store.target[i]].addr) : std::string());
+}
+
+void index_results(const Context& ctx, PriorIndex& index) {
+    const ResultStore& store = ctx.store;
+    index.clear();
+    index.reserve(store.count);
+    for (size_t i = 0; i < store.count; ++i) {
+        index[slot_key(ctx, i)] = {
+            store.verdict[i], store.kind[i] == ProbeKind::Upload ? store.uploaded[i] : store.received[i],
+            static_cast<float>(store.elapsed_ms[i])};
+    }
+}
+
+static const double DIFF_ELAPSED_MIN_MS = 500.0;   // and at least 50% relative
+static const uint64_t DIFF_STALL_MIN_BYTES = 4096;
+
+// Prints only what changed against prior: verdict flips, moved stall offsets
+// (bytes at which a detected transfer froze) and large elapsed time shifts.
+void log_diff(Context& ctx, const PriorIndex& prior) {
+    const ResultStore& store = ctx.store;
+    size_t flipped = 0, shifted = 0, added = 0, matched = 0;
+    for (size_t i = 0; i < store.count; ++i) {
+        const Test& t = ctx.tests[store.test[i]];
+        auto it = prior.find(slot_key(ctx, i));
+        if (it == prior.end()) {
+            added++;
+            continue;
+        }
+        matched++;
+        const PriorResult& old = it->second;
+        const std::string id = result_id(ctx.strings, t, store, i);
+        const Verdict now = store.verdict[i];
+        const uint64_t bytes = store.kind[i] == ProbeKind::Upload ? store.uploaded[i] : store.received[i];
+
+        if (old.verdict != now) {
+            flipped++;
+            log_msg(ctx.log, "DIFF", std::format("{}: {} -> {}", id, VERDICT_TEXT[static_cast<size_t>(old.verdict)],
+                                        VERDICT_TEXT[static_cast<size_t>(now)]));
+            continue;
+        }
+        if (is_detected(now) && (bytes > old.bytes ? bytes - old.bytes : old.bytes - bytes) >= DIFF_STALL_MIN_BYTES) {
+            shifted++;
+            log_msg(ctx.log, "DIFF", std::format("{}: stall offset {} -> {} bytes", id, old.bytes, bytes));
+            continue;
+        }
+        const double delta = store.elapsed_ms[i] - old.elapsed_ms;
+        if (std::abs(delta) >= DIFF_ELAPSED_MIN_MS && std::abs(delta) >= 0.5 * old.elapsed_ms) {
+            shifted++;
+            log_msg(ctx.log, "DIFF", std::format("{}: elapsed {:.1f} -> {:.1f} ms", id, old.elapsed_ms, store.elapsed_ms[i]));
+        }
+    }
+    log_msg(ctx.log, "DIFF", std::format("{} flipped, {} shifted, {} new, {} gone", flipped, shifted, added,
+                                prior.size() - matched));
+}
+} // namespace dpi
@@ -0,0 +1,62 @@
+// report.h - NDJSON export and run-to-run diffs
+#pragma once
+
+#include "context.h"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace dpi {
+
+// One exported result, as written to or read back from NDJSON and binary
+// history. Strings are unescaped; when read back they point into the mapped
+// file or a scratch buffer and are only valid during the callback.
+struct ResultRow {
+    std::string_view node, id, provider, ip, detail;
+    int64_t ts_ms = 0;
+    uint32_t round = 0;
+    uint32_t rep = 0;
+    bool pinned = false;
+    ProbeKind kind = ProbeKind::Download;
+    long http_code = 0;
+    uint64_t received = 0;
+    uint64_t uploaded = 0;
+    double elapsed_ms = 0;
+    double stall_ms = 0;
+    Verdict verdict = Verdict::Failed;
+    int curl_code = 0;
+};
+
+// NDJSON export: one object per result, appended per round. The "node"
+// field is only written when the row has one.
+void append_ndjson_row(std::string& out, const ResultRow& r);
+bool append_ndjson(const Context& ctx, const std::string& path, int64_t ts_ms, uint32_t round);
+
+// Calls fn for every result in an NDJSON or binary history file (detected by
+// its magic), or only for those of the last round. History rows carry the
+// node recorded in the file header.
+bool read_results(const std::string& path, bool last_round, const std::function<void(const ResultRow&)>& fn);
+
+// Minimal field readers for the flat objects append_ndjson writes.
+std::string_view json_field(std::string_view obj, std::string_view key);
+double json_number(std::string_view v);
+
+std::string diff_key(std::string_view id, uint32_t rep, bool pinned, std::string_view ip);
+
+struct PriorResult {
+    Verdict verdict;
+    uint64_t bytes;     // received (download) or acknowledged (upload) at the end
+    float elapsed_ms;
+};
+
+using PriorIndex = std::unordered_map<std::string, PriorResult>;
+
+bool load_prior(const std::string& path, PriorIndex& index);
+// Replaces index with the results of the last run in ctx.
+void index_results(const Context& ctx, PriorIndex& index);
+void log_diff(Context& ctx, const PriorIndex& prior);
+
+} // namespace dpi
@@ -0,0 +1,338 @@
+// suite.cpp - test suite loading and host pre-resolution
+
+#include "suite.h"
+#include "engine.h"
+
+#include <netdb.h>
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstring>
+#include <format>
+
+using namespace std::chrono;
+
+namespace dpi {
+
+static size_t curlWriteToString(void* contents, size_t size, size_t nmemb, void* userp) {
+    size_t totalSize = size * nmemb;
+    std::string* str = static_cast<std::string*>(userp);
+    str->append(static_cast<char*>(contents), totalSize);
+    return totalSize;
+}
+
+bool fetchJson(const std::string& url, std::string& json) { 
+    CURL* curl = curl_easy_init(); 
+    if (!curl) return false; 
+    curl_easy_setopt(curl, CURLOPT_URL, url.c_str()); 
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, curlWriteToString); 
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &json); 
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L); 
+    curl_easy_setopt(curl, CURLOPT_USERAGENT, "Mozilla/5.0"); 
+    CURLcode res = curl_easy_perform(curl); 
+    curl_easy_cleanup(curl); return res == CURLE_OK; 
+}
+
+static inline std::string trim(const std::string& s) {
+    size_t a = s.find_first_not_of(" \t\n\r");
+    size_t b = s.find_last_not_of(" \t\n\r");
+    if (a == std::string::npos) return "";
+    return s.substr(a, b - a + 1);
+}
+
+
+std::string extractTestSuiteArray(const std::string& json) {
+    auto pos = json.find('[');
+    if (pos == std::string::npos) return {};
+
+    size_t depth = 0;
+    size_t start = pos;
+
+    for (size_t i = pos; i < json.size(); ++i) {
+        if (json[i] == '[') depth++;
+        else if (json[i] == ']') {
+            depth--;
+            if (depth == 0) {
+                return json.substr(start, i - start + 1);
+            }
+        }
+    }
+    return {};
+
+
+}
+
+
+bool parseObject(StringTable& strings, const std::string& objText, Test& t) {
+auto getString = [&](const std::string& key) -> std::string {
+    std::string pat = "\"" + key + "\":";
+    size_t p = objText.find(pat);
+    if (p == std::string::npos) return "";
+    p = objText.find('"', p + pat.size());
+    if (p == std::string::npos) return "";
+    size_t q = objText.find('"', p + 1);
+    if (q == std::string::npos) return "";
+    return objText.substr(p + 1, q - (p + 1));
+};
+
+auto getInt = [&](const std::string& key) -> int {
+    std::string pat = "\"" + key + "\":";
+    size_t p = objText.find(pat);
+    if (p == std::string::npos) return 0;
+    p += pat.size();
+    while (p < objText.size() && isspace((unsigned char)objText[p])) p++;
+    size_t q = p;
+    while (q < objText.size() && isdigit((unsigned char)objText[q])) q++;
+    return std::stoi(objText.substr(p, q - p));
+};
+
+
+    std::string id = getString("id");
+    if (id.empty()) return false;
+
+    t.id       = strings.intern(id);
+    t.provider = strings.intern(getString("provider"));
+    t.url      = getString("url");
+    t.times    = getInt("times");
+    t.kind     = getString("type") == "upload" ? ProbeKind::Upload : ProbeKind::Download;
+
+    std::string protocol = getString("protocol");
+    if (protocol == "h1" || protocol == "http/1.1") t.protocol = Protocol::H1;
+    else if (protocol == "h2") t.protocol = Protocol::H2;
+    else if (protocol == "h3") t.protocol = Protocol::H3;
+    else t.protocol = Protocol::Default;
+
+    return true;
+}
+
+void parseTestSuiteVector(StringTable& strings, const std::string& arrayText, std::vector<Test>& out) {
+    size_t i = 0;
+    while (i < arrayText.size()) {
+        auto p = arrayText.find('{', i);
+        if (p == std::string::npos) break;
+
+        int depth = 0;
+        size_t start = p;
+        for (size_t j = p; j < arrayText.size(); ++j) {
+            if (arrayText[j] == '{') depth++;
+            else if (arrayText[j] == '}') {
+                depth--;
+                if (depth == 0) {
+                    std::string obj = arrayText.substr(start, j - start + 1);
+                    Test t;
+                    if (parseObject(strings, obj, t)) {
+                        out.push_back(std::move(t));
+                    }
+                    i = j + 1;
+                    break;
+                }
+            }
+        }
+        i++;
+    }
+}
+
+uint32_t shard_of(std::string_view id, uint32_t count) {
+    uint64_t h = 0xcbf29ce484222325ULL;   // FNV-1a
+    for (unsigned char c : id) h = (h ^ c) * 0x100000001b3ULL;
+    uint32_t best = 0;
+    uint64_t best_weight = 0;
+    for (uint32_t s = 0; s < count; ++s) {
+        uint64_t w = splitmix64(h ^ splitmix64(s));
+        if (w > best_weight || s == 0) {
+            best = s;
+            best_weight = w;
+        }
+    }
+    return best;
+}
+
+bool loadTestSuiteFromJson(Context& ctx, const std::string& json) {
+    TraceScope span(ctx.trace, 0, "suite", "suite_parse");
+    std::string arr = extractTestSuiteArray(json);
+    if (arr.empty()) return false;
+
+    free_resolved(ctx.tests);
+    ctx.tests.clear();
+    parseTestSuiteVector(ctx.strings, arr, ctx.tests);
+
+    const Config& cfg = ctx.cfg;
+    if (cfg.shard_count > 1) {
+        const size_t total = ctx.tests.size();
+        std::erase_if(ctx.tests, [&](const Test& t) {
+            return shard_of(ctx.strings.str(t.id), cfg.shard_count) != cfg.shard_index;
+        });
+        log_msg(ctx.log, "SUITE", std::format("Shard {}/{}: {} of {} tests", cfg.shard_index + 1, cfg.shard_count,
+                                              ctx.tests.size(), total));
+    }
+    return true;
+}
+
+bool loadTestSuiteFromUrl(Context& ctx, const std::string& url) {
+    std::string json;
+    {
+        TraceScope span(ctx.trace, 0, "suite", "suite_fetch");
+        if (!fetchJson(url, json)) return false;
+    }
+    return loadTestSuiteFromJson(ctx, json);
+}
+
+
+static std::string resolve_entry(const std::string& host, const std::string& port, const IpAddr& a) {
+    return a.family == 6 ? std::format("{}:{}:[{}]", host, port, ip_text(a))
+                         : std::format("{}:{}:{}", host, port, ip_text(a));
+}
+
+// Pre-resolution stage: every distinct suite host is looked up once, all in
+// flight at the same time through getaddrinfo_a, before any probe starts.
+// The answers are injected with CURLOPT_RESOLVE so elapsed_ms no longer
+// contains DNS time. In the default mode a test is pinned to all addresses
+// of its host; --dual-stack keeps one address per family and --per-ip turns
+// every address into its own probe group. IP literal hosts are left alone.
+void preresolve(Context& ctx) {
+    std::vector<Test>& tests = ctx.tests;
+    struct Host {
+        std::string name;
+        std::vector<IpAddr> addrs;
+        int error = 0;
+    };
+    std::vector<Host> hosts;
+    std::vector<size_t> host_of(tests.size(), SIZE_MAX);
+    std::vector<std::string> port_of(tests.size());
+
+    for (size_t ti = 0; ti < tests.size(); ++ti) {
+        CURLU* u = curl_url();
+        char* host = nullptr;
+        char* port = nullptr;
+        if (curl_url_set(u, CURLUPART_URL, tests[ti].url.c_str(), 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_HOST, &host, 0) == CURLUE_OK &&
+            curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) == CURLUE_OK &&
+            host[0] != '[' && parse_ip(host).family == 0) {
+            auto it = std::find_if(hosts.begin(), hosts.end(), [&](const Host& h) { return h.name == host; });
+            if (it == hosts.end()) it = hosts.insert(hosts.end(), Host{host, {}, 0});
+            host_of[ti] = it - hosts.begin();
+            port_of[ti] = port;
+        }
+        curl_free(host);
+        curl_free(port);
+        curl_url_cleanup(u);
+    }
+    if (hosts.empty()) return;
+
+    addrinfo hints{};
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    std::vector<gaicb> reqs(hosts.size());
+    std::vector<gaicb*> pending(hosts.size());
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        reqs[i] = gaicb{};
+        reqs[i].ar_name = hosts[i].name.c_str();
+        reqs[i].ar_request = &hints;
+        pending[i] = &reqs[i];
+    }
+
+    const long long start_us = ctx.trace.now_us();
+    const auto deadline = steady_clock::now() + milliseconds(ctx.cfg.timeout_ms);
+    int rc = getaddrinfo_a(GAI_NOWAIT, pending.data(), static_cast<int>(pending.size()), nullptr);
+    if (rc != 0) {
+        log_msg(ctx.log, "DNS", std::format("getaddrinfo_a failed: {}", gai_strerror(rc)));
+        return;
+    }
+
+    size_t left = hosts.size();
+    while (left > 0) {
+        auto now = steady_clock::now();
+        if (now >= deadline) break;
+        auto wait = duration_cast<nanoseconds>(deadline - now);
+        timespec ts{static_cast<time_t>(wait.count() / 1000000000), static_cast<long>(wait.count() % 1000000000)};
+        gai_suspend(pending.data(), static_cast<int>(pending.size()), &ts);
+
+        for (size_t i = 0; i < hosts.size(); ++i) {
+            if (!pending[i]) continue;
+            int e = gai_error(&reqs[i]);
+            if (e == EAI_INPROGRESS) continue;
+            pending[i] = nullptr;
+            left--;
+
+            Host& h = hosts[i];
+            h.error = e;
+            const long long done_us = ctx.trace.now_us();
+            ctx.trace.span(0, "dns", "resolve " + h.name, start_us, done_us - start_us);
+            if (e != 0) {
+                log_msg(ctx.log, "DNS", std::format("{}: {}", h.name, gai_strerror(e)));
+                continue;
+            }
+            for (addrinfo* ai = reqs[i].ar_result; ai; ai = ai->ai_next) {
+                IpAddr a;
+                if (ai->ai_family == AF_INET) {
+                    a.family = 4;
+                    std::memcpy(a.bytes, &reinterpret_cast<sockaddr_in*>(ai->ai_addr)->sin_addr, 4);
+                } else if (ai->ai_family == AF_INET6) {
+                    a.family = 6;
+                    std::memcpy(a.bytes, &reinterpret_cast<sockaddr_in6*>(ai->ai_addr)->sin6_addr, 16);
+                } else {
+                    continue;
+                }
+                if (std::none_of(h.addrs.begin(), h.addrs.end(), [&](const IpAddr& b) { return same_ip(a, b); })) {
+                    h.addrs.push_back(a);
+                }
+            }
+            freeaddrinfo(reqs[i].ar_result);
+            log_msg(ctx.log, "DNS", std::format("{}: {} address(es) in {:.1f} ms",
+                                       h.name, h.addrs.size(), (done_us - start_us) / 1000.0));
+        }
+    }
+    for (size_t i = 0; i < hosts.size(); ++i) {
+        if (!pending[i]) continue;
+        if (gai_cancel(&reqs[i]) == EAI_CANCELED) {
+            log_msg(ctx.log, "DNS", hosts[i].name + ": timed out, left to curl");
+        } else {
+            // Too late to cancel: wait for it so reqs can be released safely.
+            const gaicb* one[] = {&reqs[i]};
+            while (gai_error(&reqs[i]) == EAI_INPROGRESS) gai_suspend(one, 1, nullptr);
+            if (gai_error(&reqs[i]) == 0) freeaddrinfo(reqs[i].ar_result);
+        }
+    }
+
+    for (size_t ti = 0; ti < tests.size(); ++ti) {
+        if (host_of[ti] == SIZE_MAX) continue;
+        const Host& h = hosts[host_of[ti]];
+        if (h.addrs.empty()) continue;
+        Test& t = tests[ti];
+
+        if (ctx.cfg.addr_mode == AddrMode::Default) {
+            std::string entry = resolve_entry(h.name, port_of[ti], h.addrs[0]);
+            for (size_t i = 1; i < h.addrs.size(); ++i) {
+                entry += ",";
+                entry += h.addrs[i].family == 6 ? "[" + ip_text(h.addrs[i]) + "]" : ip_text(h.addrs[i]);
+            }
+            t.resolve = curl_slist_append(nullptr, entry.c_str());
+            continue;
+        }
+
+        bool have4 = false, have6 = false;
+        for (const auto& a : h.addrs) {
+            if (ctx.cfg.addr_mode == AddrMode::PerFamily) {
+                bool& have = a.family == 4 ? have4 : have6;
+                if (have) continue;
+                have = true;
+            }
+            Target tg;
+            tg.addr = a;
+            tg.resolve = curl_slist_append(nullptr, resolve_entry(h.name, port_of[ti], a).c_str());
+            t.targets.push_back(tg);
+            if (t.targets.size() == NO_TARGET) break;
+        }
+    }
+}
+
+void free_resolved(std::vector<Test>& tests) {
+    for (auto& t : tests) {
+        for (auto& tg : t.targets) curl_slist_free_all(tg.resolve);
+        t.targets.clear();
+        curl_slist_free_all(t.resolve);
+        t.resolve = nullptr;
+    }
+}
+
+} // namespace dpi
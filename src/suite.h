@@ -0,0 +1,31 @@
+// suite.h - test suite loading and host pre-resolution
+#pragma once
+
+#include "context.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dpi {
+
+bool fetchJson(const std::string& url, std::string& json);
+std::string extractTestSuiteArray(const std::string& json);
+bool parseObject(StringTable& strings, const std::string& objText, Test& t);
+void parseTestSuiteVector(StringTable& strings, const std::string& arrayText, std::vector<Test>& out);
+
+// Rendezvous (highest random weight) hashing of the test id: a test belongs
+// to the shard with the highest hash(id, shard). Every node computes the same
+// split from the suite alone, and going from N to N+1 shards only moves the
+// tests the new shard wins.
+uint32_t shard_of(std::string_view id, uint32_t count);
+
+// Both replace ctx.tests on success and leave it untouched otherwise.
+bool loadTestSuiteFromJson(Context& ctx, const std::string& json);
+bool loadTestSuiteFromUrl(Context& ctx, const std::string& url);
+
+void preresolve(Context& ctx);
+void free_resolved(std::vector<Test>& tests);
+
+} // namespace dpi
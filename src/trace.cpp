@@ -0,0 +1,98 @@
+// trace.cpp - Chrome trace collection and export
+
+#include "trace.h"
+#include "types.h"
+
+#include <format>
+#include <fstream>
+
+using namespace std::chrono;
+
+namespace dpi {
+
+long long Tracer::now_us() const {
+    return duration_cast<microseconds>(steady_clock::now() - epoch).count();
+}
+
+void Tracer::span(int tid, const char* cat, std::string name, long long ts_us, long long dur_us, std::string args) {
+    if (!enabled) return;
+    std::lock_guard<std::mutex> lk(mtx);
+    events.push_back({std::move(name), cat, tid, ts_us, dur_us, std::move(args)});
+}
+
+void Tracer::track(int tid, std::string name) {
+    if (!enabled) return;
+    std::lock_guard<std::mutex> lk(mtx);
+    const size_t i = static_cast<size_t>(tid);
+    if (i >= tracks.size()) tracks.resize(i + 1);
+    if (tracks[i].empty()) tracks[i] = std::move(name);
+}
+
+void Tracer::label(std::string text) {
+    if (!enabled) return;
+    std::lock_guard<std::mutex> lk(mtx);
+    labels.push_back(std::move(text));
+}
+
+bool Tracer::write(const std::string& path) {
+    std::ofstream f(path, std::ios::trunc);
+    if (!f) return false;
+
+    std::lock_guard<std::mutex> lk(mtx);
+    f << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    f << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"dpi_check\"}}";
+    if (!labels.empty()) {
+        std::string joined;
+        for (const auto& l : labels) joined += (joined.empty() ? "" : ", ") + l;
+        f << std::format(",\n{{\"ph\":\"M\",\"name\":\"process_labels\",\"pid\":1,\"tid\":0,\"args\":{{\"labels\":\"{}\"}}}}",
+                         json_escape(joined));
+    }
+    for (size_t tid = 0; tid < tracks.size(); ++tid) {
+        const std::string& name = tracks[tid];
+        if (name.empty()) continue;
+        f << std::format(",\n{{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                         tid, json_escape(name));
+        f << std::format(",\n{{\"ph\":\"M\",\"name\":\"thread_sort_index\",\"pid\":1,\"tid\":{},\"args\":{{\"sort_index\":{}}}}}",
+                         tid, tid);
+    }
+    for (const auto& e : events) {
+        f << std::format(",\n{{\"ph\":\"X\",\"cat\":\"{}\",\"name\":\"{}\",\"pid\":1,\"tid\":{},\"ts\":{},\"dur\":{}",
+                         e.cat, json_escape(e.name), e.tid, e.ts_us, e.dur_us);
+        if (!e.args.empty()) f << ",\"args\":" << e.args;
+        f << "}";
+    }
+    f << "\n]}\n";
+    return f.good();
+}
+
+void Tracer::clear() {
+    std::lock_guard<std::mutex> lk(mtx);
+    events.clear();
+    labels.clear();
+    if (tracks.size() > 1) tracks.resize(1);
+}
+
+void trace_transfer(Tracer& tr, CURL* curl, int tid, long long perform_start_us) {
+    if (!tr.enabled) return;
+
+    curl_off_t dns = 0, connect = 0, tls = 0, pre = 0, ttfb = 0, total = 0;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &dns);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &connect);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &tls);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &pre);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total);
+
+    auto phase = [&](const char* name, curl_off_t from, curl_off_t to) {
+        if (to > from) tr.span(tid, "curl", name, perform_start_us + from, to - from);
+    };
+
+    phase("dns", 0, dns);
+    phase("tcp_connect", dns, connect);
+    if (tls > 0) phase("tls", connect, tls);
+    // No first byte means the whole remainder was spent waiting for it.
+    phase("ttfb", pre, ttfb > 0 ? ttfb : total);
+    if (ttfb > 0) phase("transfer", ttfb, total);
+}
+
+} // namespace dpi
@@ -0,0 +1,59 @@
+// trace.h - Chrome trace (chrome://tracing / Perfetto) collection
+#pragma once
+
+#include <curl/curl.h>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace dpi {
+
+struct TraceEvent {
+    std::string name;
+    const char* cat;
+    int tid;
+    long long ts_us;
+    long long dur_us;
+    std::string args;
+};
+
+// Track 0 is the main thread, every probe gets its own track so phases line
+// up per transfer. Collection is a no-op unless enabled. A trace covers one
+// run: clear() drops the previous one, keeping the main track.
+struct Tracer {
+    bool enabled = false;
+    std::mutex mtx;
+    std::vector<TraceEvent> events;
+    std::vector<std::string> tracks;    // name by tid, empty if unnamed
+    std::vector<std::string> labels;    // run metadata, shown as process labels
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    long long now_us() const;
+    void span(int tid, const char* cat, std::string name, long long ts_us, long long dur_us, std::string args = {});
+    // Names a track; a track that already has a name keeps it.
+    void track(int tid, std::string name);
+    void label(std::string text);
+    bool write(const std::string& path);
+    void clear();
+};
+
+struct TraceScope {
+    Tracer& tr;
+    int tid;
+    const char* cat;
+    const char* name;
+    long long start_us;
+
+    TraceScope(Tracer& tr, int tid, const char* cat, const char* name)
+        : tr(tr), tid(tid), cat(cat), name(name), start_us(tr.enabled ? tr.now_us() : 0) {}
+    ~TraceScope() {
+        if (tr.enabled) tr.span(tid, cat, name, start_us, tr.now_us() - start_us);
+    }
+};
+
+// Splits curl's cumulative timers into DNS / connect / TLS / TTFB / transfer
+// spans, anchored at the moment the transfer was started.
+void trace_transfer(Tracer& tr, CURL* curl, int tid, long long perform_start_us);
+
+} // namespace dpi
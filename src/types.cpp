@@ -0,0 +1,171 @@
+// types.cpp - address helpers, result arena and result text formatting
+
+#include "types.h"
+
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstring>
+#include <format>
+#include <iterator>
+
+namespace dpi {
+
+static const char* ip_cstr(const IpAddr& a, char (&buf)[INET6_ADDRSTRLEN]) {
+    buf[0] = '\0';
+    if (a.family == 4) inet_ntop(AF_INET, a.bytes, buf, sizeof(buf));
+    else if (a.family == 6) inet_ntop(AF_INET6, a.bytes, buf, sizeof(buf));
+    return buf;
+}
+
+std::string ip_text(const IpAddr& a) {
+    char buf[INET6_ADDRSTRLEN];
+    return ip_cstr(a, buf);
+}
+
+IpAddr parse_ip(const char* text) {
+    IpAddr a;
+    if (!text) return a;
+    if (inet_pton(AF_INET, text, a.bytes) == 1) a.family = 4;
+    else if (inet_pton(AF_INET6, text, a.bytes) == 1) a.family = 6;
+    return a;
+}
+
+bool same_ip(const IpAddr& a, const IpAddr& b) {
+    return a.family == b.family && std::memcmp(a.bytes, b.bytes, sizeof(a.bytes)) == 0;
+}
+
+void ResultStore::allocate(size_t n) {
+    size_t off = 0;
+    auto carve = [&](auto*& ptr) {
+        using T = std::remove_reference_t<decltype(*ptr)>;
+        off = (off + alignof(T) - 1) / alignof(T) * alignof(T);
+        size_t at = off;
+        off += sizeof(T) * n;
+        return at;
+    };
+    size_t o_test = carve(test), o_id = carve(id), o_provider = carve(provider),
+           o_rep = carve(rep), o_target = carve(target), o_ip = carve(ip), o_code = carve(http_code),
+           o_recv = carve(received), o_elapsed = carve(elapsed_ms),
+           o_stall = carve(stall_ms), o_uploaded = carve(uploaded), o_curl = carve(curl_code),
+           o_port = carve(local_port), o_version = carve(http_version),
+           o_kind = carve(kind), o_verdict = carve(verdict), o_detail = carve(detail);
+
+    arena_ = std::make_unique<std::byte[]>(off);
+    std::byte* base = arena_.get();
+    test       = reinterpret_cast<uint32_t*>(base + o_test);
+    id         = reinterpret_cast<uint32_t*>(base + o_id);
+    provider   = reinterpret_cast<uint32_t*>(base + o_provider);
+    rep        = reinterpret_cast<uint32_t*>(base + o_rep);
+    target     = reinterpret_cast<uint16_t*>(base + o_target);
+    ip         = reinterpret_cast<IpAddr*>(base + o_ip);
+    http_code  = reinterpret_cast<long*>(base + o_code);
+    received   = reinterpret_cast<size_t*>(base + o_recv);
+    elapsed_ms = reinterpret_cast<double*>(base + o_elapsed);
+    stall_ms   = reinterpret_cast<double*>(base + o_stall);
+    uploaded   = reinterpret_cast<size_t*>(base + o_uploaded);
+    curl_code  = reinterpret_cast<int*>(base + o_curl);
+    local_port = reinterpret_cast<uint16_t*>(base + o_port);
+    http_version = reinterpret_cast<uint8_t*>(base + o_version);
+    kind       = reinterpret_cast<ProbeKind*>(base + o_kind);
+    verdict    = reinterpret_cast<Verdict*>(base + o_verdict);
+    detail     = reinterpret_cast<Detail*>(base + o_detail);
+    count = n;
+}
+
+std::string json_escape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        switch (c) {
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            if ((unsigned char)c < 0x20) out += std::format("\\u{:04x}", (unsigned)c);
+            else out += c;
+        }
+    }
+    return out;
+}
+
+// Inverse of json_escape; \u escapes are re-encoded as UTF-8 (no surrogate
+// pairs, json_escape never writes them).
+std::string json_unescape(std::string_view s) {
+    std::string out;
+    out.reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) {
+        if (s[i] != '\\' || i + 1 == s.size()) {
+            out += s[i];
+            continue;
+        }
+        char c = s[++i];
+        switch (c) {
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'u': {
+            unsigned cp = 0;
+            if (i + 4 >= s.size() || std::from_chars(s.data() + i + 1, s.data() + i + 5, cp, 16).ptr != s.data() + i + 5) {
+                out += c;
+                break;
+            }
+            i += 4;
+            if (cp < 0x80) {
+                out += static_cast<char>(cp);
+            } else if (cp < 0x800) {
+                out += static_cast<char>(0xc0 | cp >> 6);
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            } else {
+                out += static_cast<char>(0xe0 | cp >> 12);
+                out += static_cast<char>(0x80 | (cp >> 6 & 0x3f));
+                out += static_cast<char>(0x80 | (cp & 0x3f));
+            }
+            break;
+        }
+        default: out += c;   // \" \\ \/
+        }
+    }
+    return out;
+}
+
+void append_detail_text(std::string& out, Detail detail, int curl_code) {
+    if (detail == Detail::CurlError) {
+        std::format_to(std::back_inserter(out), "curl_error={} ({})", curl_code,
+                       curl_easy_strerror(static_cast<CURLcode>(curl_code)));
+        return;
+    }
+    out += DETAIL_TEXT[static_cast<size_t>(detail)];
+}
+
+std::string detail_text(Detail detail, int curl_code) {
+    std::string out;
+    append_detail_text(out, detail, curl_code);
+    return out;
+}
+
+std::string detail_text(const ResultStore& store, size_t i) {
+    return detail_text(store.detail[i], store.curl_code[i]);
+}
+
+void append_result_id(std::string& out, const StringTable& strings, const Test& t, const ResultStore& store,
+                      size_t slot) {
+    out += strings.str(t.id);
+    if (t.times > 1) std::format_to(std::back_inserter(out), "@{}", store.rep[slot]);
+    if (store.target[slot] != NO_TARGET) {
+        char buf[INET6_ADDRSTRLEN];
+        out += '/';
+        out += ip_cstr(t.targets[store.target[slot]].addr, buf);
+    }
+}
+
+std::string result_id(const StringTable& strings, const Test& t, const ResultStore& store, size_t slot) {
+    std::string id;
+    append_result_id(id, strings, t, store, slot);
+    return id;
+}
+
+} // namespace dpi
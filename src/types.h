@@ -0,0 +1,183 @@
+// types.h - suite, result and string types shared by the probe engine
+#pragma once
+
+#include <curl/curl.h>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace dpi {
+
+inline constexpr size_t OK_THRESHOLD_BYTES = 64 * 1024;
+inline constexpr size_t UPLOAD_BYTES = 1024 * 1024;
+inline constexpr size_t UPLOAD_CHUNK_BYTES = 16 * 1024;
+
+// Interned strings (test ids, providers). Each distinct value is stored once
+// and referenced by a 32-bit handle; the table is filled while the suite is
+// parsed and is read-only once probes start.
+struct StringTable {
+    std::deque<std::string> values;
+    std::unordered_map<std::string_view, uint32_t> index;
+
+    uint32_t intern(std::string_view s) {
+        auto it = index.find(s);
+        if (it != index.end()) return it->second;
+        uint32_t h = static_cast<uint32_t>(values.size());
+        values.emplace_back(s);
+        index.emplace(values.back(), h);
+        return h;
+    }
+
+    const std::string& str(uint32_t h) const { return values[h]; }
+};
+
+// Per-test "protocol" suite field. h3 probes go through the multi engine.
+enum class Protocol : uint8_t { Default, H1, H2, H3 };
+
+struct IpAddr {
+    uint8_t family = 0;   // 0 unknown, 4 or 6
+    uint8_t bytes[16] = {};
+};
+
+// A resolved address a test is pinned to through CURLOPT_RESOLVE.
+struct Target {
+    IpAddr addr;
+    curl_slist* resolve = nullptr;
+};
+
+inline constexpr uint16_t NO_TARGET = 0xffff;
+
+std::string ip_text(const IpAddr& a);
+IpAddr parse_ip(const char* text);
+bool same_ip(const IpAddr& a, const IpAddr& b);
+
+// Per-test "type" suite field: download (default) or upload freeze probe.
+enum class ProbeKind : uint8_t { Download, Upload };
+
+struct Test {
+    uint32_t id{};
+    uint32_t provider{};
+    std::string url;
+    int times{};
+    Protocol protocol = Protocol::Default;
+    ProbeKind kind = ProbeKind::Download;
+    std::vector<Target> targets;   // empty unless --dual-stack / --per-ip
+    curl_slist* resolve = nullptr; // all addresses of the host (default mode)
+};
+
+enum class Verdict : uint8_t {
+    NotDetected,
+    PossiblyDetected,
+    DetectedBlocked,
+    Detected,
+    Failed,
+    Count
+};
+
+enum class Detail : uint8_t {
+    None,
+    ThresholdReceived,
+    StreamTooSmall,
+    TimeoutZeroBytes,
+    TimeoutPartial,
+    EarlyAbort,
+    UnexpectedAbort,
+    CurlError,
+    InitFailed,
+    Unsupported,
+    UploadStalled
+};
+
+inline constexpr const char* VERDICT_TEXT[] = {
+    "Not detected ✅",
+    "Possibly detected ⚠️",
+    "Detected* ❗️",
+    "Detected ❗️",
+    "Failed to complete detection ⚠️",
+};
+
+// Stable machine-readable verdict names used in NDJSON output.
+inline constexpr const char* VERDICT_KEY[] = {
+    "not_detected",
+    "possibly_detected",
+    "detected_blocked",
+    "detected",
+    "failed",
+};
+
+inline constexpr const char* DETAIL_TEXT[] = {
+    "",
+    "Received >= threshold",
+    "Stream ended, data too small",
+    "Timeout with zero bytes (likely connection blocked)",
+    "Timeout after partial data (read blocked)",
+    "Early abort: threshold reached",
+    "Unexpected abort before threshold",
+    "curl_error",
+    "curl_easy_init failed",
+    "Protocol not supported by libcurl",
+    "Timeout after partial upload (write blocked)",
+};
+
+inline bool is_detected(Verdict v) { return v == Verdict::Detected || v == Verdict::DetectedBlocked; }
+
+// Live per-transfer state touched by the curl callbacks. It stays with the
+// probe and is committed to the ResultStore once the probe is done, so
+// workers never write to shared cache lines while data is flowing.
+struct ProbeState {
+    size_t received = 0;
+    size_t upload_queued = 0;   // bytes handed to curl by read_cb
+    size_t upload_acked = 0;    // bytes the peer has acknowledged
+    bool upload = false;
+    bool aborted_by_threshold = false;
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    const char* payload = nullptr;  // the context's shared upload buffer
+    std::chrono::steady_clock::time_point last_progress;
+};
+
+// All results of a run, allocated once as a single arena and laid out as
+// structure-of-arrays. Slot i belongs to exactly one worker, so no locking.
+struct ResultStore {
+    size_t count = 0;
+    uint32_t* test = nullptr;   // index into the suite vector
+    uint32_t* id = nullptr;     // StringTable handle
+    uint32_t* provider = nullptr;
+    uint32_t* rep = nullptr;    // repetition index within the test
+    uint16_t* target = nullptr; // index into Test::targets or NO_TARGET
+    IpAddr* ip = nullptr;       // address actually connected to
+    long* http_code = nullptr;
+    size_t* received = nullptr;
+    double* elapsed_ms = nullptr;
+    double* stall_ms = nullptr;       // time since the last byte moved when the probe ended
+    size_t* uploaded = nullptr;       // acknowledged upload bytes
+    int* curl_code = nullptr;
+    uint16_t* local_port = nullptr;   // identifies the connection a stream rode on
+    uint8_t* http_version = nullptr;  // CURL_HTTP_VERSION_* actually negotiated
+    ProbeKind* kind = nullptr;
+    Verdict* verdict = nullptr;
+    Detail* detail = nullptr;
+
+    void allocate(size_t n);
+
+private:
+    std::unique_ptr<std::byte[]> arena_;
+};
+
+std::string json_escape(std::string_view s);
+std::string json_unescape(std::string_view s);
+std::string detail_text(Detail detail, int curl_code);
+std::string detail_text(const ResultStore& store, size_t i);
+// Display id of a result: "id", "id@rep" and/or "/ip" for pinned probes.
+std::string result_id(const StringTable& strings, const Test& t, const ResultStore& store, size_t slot);
+// The same two texts appended to out, so hot paths can reuse one buffer.
+void append_detail_text(std::string& out, Detail detail, int curl_code);
+void append_result_id(std::string& out, const StringTable& strings, const Test& t, const ResultStore& store,
+                      size_t slot);
+
+} // namespace dpi